@@ -98,11 +98,12 @@ extern "C" void main(int argc, char** argv) {
         static unsigned long prev_timeout = 0;
         if (prev_timeout == 0) {
             const auto timeout =
-                SyscallCreateTimer(TIMER_ONESHOT_REL, 1, 1000 / kFrameRate);
+                SyscallCreateTimer(TIMER_ONESHOT_REL, 1, 1000 / kFrameRate,
+                                   nullptr);
             prev_timeout = timeout.value;
         } else {
             prev_timeout += 1000 / kFrameRate;
-            SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout);
+            SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout, nullptr);
         }
 
         // #@@range_begin(read_event)
@@ -167,11 +167,11 @@ void DrawSurface(uint64_t layer_id, int sur) {
 bool Sleep(unsigned long ms) {
     static unsigned long prev_timeout = 0;
     if (prev_timeout == 0) {
-        const auto timeout = SyscallCreateTimer(TIMER_ONESHOT_REL, 1, ms);
+        const auto timeout = SyscallCreateTimer(TIMER_ONESHOT_REL, 1, ms, nullptr);
         prev_timeout = timeout.value;
     } else {
         prev_timeout += ms;
-        SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout);
+        SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout, nullptr);
     }
 
     AppEvent events[1];
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../sync.h"
+#include "../syscall.h"
+
+namespace {
+const int kQueueSize = 8;
+const int kNumConsumers = 3;
+
+struct BoundedQueue {
+    Mutex mutex;
+    CondVar not_empty, not_full;
+    int items[kQueueSize];
+    int head = 0, count = 0;
+    // 全て送り終えたらtrue．待っている消費者全員をBroadcastで起こす
+    bool done = false;
+};
+
+struct Consumer {
+    BoundedQueue* queue;
+    int num_items;
+    long sum;
+};
+
+void ConsumeThread(void* arg) {
+    auto c = reinterpret_cast<Consumer*>(arg);
+    auto& q = *c->queue;
+    while (true) {
+        q.mutex.Lock();
+        while (q.count == 0 && !q.done) {
+            q.not_empty.Wait(q.mutex);
+        }
+        if (q.count == 0) {
+            q.mutex.Unlock();
+            break;
+        }
+        c->sum += q.items[q.head];
+        ++c->num_items;
+        q.head = (q.head + 1) % kQueueSize;
+        --q.count;
+        q.not_full.Signal();
+        q.mutex.Unlock();
+    }
+    SyscallExit(0);
+}
+}  // namespace
+
+extern "C" void main(int argc, char** argv) {
+    int num_items = 1000;
+    if (argc >= 2) {
+        num_items = atoi(argv[1]);
+    }
+
+    BoundedQueue queue;
+    Consumer consumers[kNumConsumers];
+    uint64_t thread_ids[kNumConsumers];
+
+    const size_t kThreadStackSize = 16 * 1024;
+    std::vector<uint8_t> thread_stack(kThreadStackSize * kNumConsumers);
+    for (int i = 0; i < kNumConsumers; ++i) {
+        consumers[i] = Consumer{&queue, 0, 0};
+        auto [thread_id, err] = SyscallCreateThread(
+            ConsumeThread, &consumers[i],
+            &thread_stack[kThreadStackSize * (i + 1)]);
+        if (err) {
+            fprintf(stderr, "failed to create thread: %d\n", err);
+            exit(1);
+        }
+        thread_ids[i] = thread_id;
+    }
+
+    for (int i = 1; i <= num_items; ++i) {
+        queue.mutex.Lock();
+        while (queue.count == kQueueSize) {
+            queue.not_full.Wait(queue.mutex);
+        }
+        queue.items[(queue.head + queue.count) % kQueueSize] = i;
+        ++queue.count;
+        queue.not_empty.Signal();
+        queue.mutex.Unlock();
+    }
+
+    // 空の待ち行列で眠っている消費者を全員起こして終わらせる
+    queue.mutex.Lock();
+    queue.done = true;
+    queue.not_empty.Broadcast(queue.mutex);
+    queue.mutex.Unlock();
+
+    int received = 0;
+    long sum = 0;
+    for (int i = 0; i < kNumConsumers; ++i) {
+        SyscallJoinThread(thread_ids[i]);
+        received += consumers[i].num_items;
+        sum += consumers[i].sum;
+    }
+    printf("received %d items in %d threads, sum = %ld\n", received,
+           kNumConsumers, sum);
+    exit(0);
+}
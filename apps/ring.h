@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include "syscall.h"
+
+// システムコールをリングへ積み，まとめて投入する
+// 満杯になったときとFlushのときだけ実際にsyscallを呼ぶ
+class SyscallBatch {
+   public:
+    // 成功した要求の完了は受け取らない
+    void Push(uint32_t number, uint64_t a1 = 0, uint64_t a2 = 0,
+              uint64_t a3 = 0, uint64_t a4 = 0, uint64_t a5 = 0,
+              uint64_t a6 = 0) {
+        if (ring_.sq_tail - ring_.sq_head == SYSCALL_RING_ENTRIES) {
+            Flush();
+        }
+        auto& e = ring_.sq[ring_.sq_tail % SYSCALL_RING_ENTRIES];
+        e.number = number;
+        e.flags = SYSCALL_RING_SKIP_SUCCESS;
+        e.args[0] = a1;
+        e.args[1] = a2;
+        e.args[2] = a3;
+        e.args[3] = a4;
+        e.args[4] = a5;
+        e.args[5] = a6;
+        e.user_data = ring_.sq_tail;
+        ++ring_.sq_tail;
+    }
+
+    void WinFillRectangle(uint64_t layer_id_flags, int x, int y, int w, int h,
+                          uint32_t color) {
+        Push(0x80000005, layer_id_flags, x, y, w, h, color);
+    }
+
+    void WinRedraw(uint64_t layer_id_flags) {
+        Push(0x80000007, layer_id_flags);
+    }
+
+    // 積んだ要求を全て実行する．失敗した要求の数を返す
+    int Flush() {
+        while (ring_.sq_head != ring_.sq_tail) {
+            SyscallSubmitRing(&ring_, ring_.sq_tail - ring_.sq_head);
+            // 失敗した要求の完了を読み捨てる
+            failed_ += ring_.cq_tail - ring_.cq_head;
+            ring_.cq_head = ring_.cq_tail;
+        }
+        const int failed = failed_;
+        failed_ = 0;
+        return failed;
+    }
+
+   private:
+    SyscallRing ring_{};
+    int failed_ = 0;
+};
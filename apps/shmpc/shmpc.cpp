@@ -0,0 +1,85 @@
+#include <fcntl.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../sync.h"
+#include "../syscall.h"
+
+// 別々のプロセス間で共有メモリ越しにデータを受け渡す
+//   noterm shmpc send 1000
+//   shmpc recv 1000
+namespace {
+const int kQueueSize = 8;
+const size_t kBlockSize = 4096;
+
+// 共有メモリは0で初期化されて渡されるので，そのまま使える
+struct BlockQueue {
+    Mutex mutex;
+    CondVar not_empty, not_full;
+    int head, count;
+    uint8_t blocks[kQueueSize][kBlockSize];
+};
+
+void Send(BlockQueue& q, int num_blocks) {
+    for (int i = 0; i < num_blocks; ++i) {
+        q.mutex.Lock();
+        while (q.count == kQueueSize) {
+            q.not_full.Wait(q.mutex);
+        }
+        memset(q.blocks[(q.head + q.count) % kQueueSize], i & 0xff,
+               kBlockSize);
+        ++q.count;
+        q.not_empty.Signal();
+        q.mutex.Unlock();
+    }
+}
+
+long Receive(BlockQueue& q, int num_blocks) {
+    long sum = 0;
+    for (int i = 0; i < num_blocks; ++i) {
+        q.mutex.Lock();
+        while (q.count == 0) {
+            q.not_empty.Wait(q.mutex);
+        }
+        for (size_t j = 0; j < kBlockSize; ++j) {
+            sum += q.blocks[q.head][j];
+        }
+        q.head = (q.head + 1) % kQueueSize;
+        --q.count;
+        q.not_full.Signal();
+        q.mutex.Unlock();
+    }
+    return sum;
+}
+}  // namespace
+
+extern "C" void main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s send|recv [<blocks>]\n", argv[0]);
+        exit(1);
+    }
+
+    int num_blocks = 1000;
+    if (argc >= 3) {
+        num_blocks = atoi(argv[2]);
+    }
+
+    size_t size = sizeof(BlockQueue);
+    auto [addr, err] = SyscallOpenSharedMemory("shmpc", &size, O_CREAT);
+    if (err) {
+        fprintf(stderr, "failed to open shared memory: %d\n", err);
+        exit(1);
+    }
+    auto& queue = *reinterpret_cast<BlockQueue*>(addr);
+
+    if (strcmp(argv[1], "send") == 0) {
+        Send(queue, num_blocks);
+        printf("sent %d blocks\n", num_blocks);
+    } else {
+        const long sum = Receive(queue, num_blocks);
+        printf("received %d blocks, sum = %ld\n", num_blocks, sum);
+    }
+    exit(0);
+}
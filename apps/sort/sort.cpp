@@ -1,8 +1,35 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
 #include <vector>
 
+#include "../syscall.h"
+
+namespace {
+bool LessLine(const std::string& a, const std::string& b) {
+    for (int i = 0; i < std::min(a.length(), b.length()); i++) {
+        if (a[i] < b[i]) {
+            return true;
+        } else if (a[i] > b[i]) {
+            return false;
+        }
+    }
+
+    return a.length() < b.length();
+}
+
+struct SortRange {
+    std::vector<std::string>::iterator begin, end;
+};
+
+void SortThread(void* arg) {
+    auto range = reinterpret_cast<SortRange*>(arg);
+    std::sort(range->begin, range->end, LessLine);
+    SyscallExit(0);
+}
+}  // namespace
+
 extern "C" void main(int argc, char** argv) {
     FILE* fp = stdin;
     if (argc >= 2) {
@@ -19,23 +46,25 @@ extern "C" void main(int argc, char** argv) {
         lines.push_back(line);
     }
 
-    auto comp = [](const std::string& a, const std::string& b) {
-        for (int i = 0; i < std::min(a.length(), b.length()); i++) {
-            if (a[i] < b[i]) {
-                return true;
-            } else if (a[i] > b[i]) {
-                return false;
-            }
-        }
+    // 前半を別のスレッドでソートし，最後にマージする
+    const size_t kThreadStackSize = 64 * 1024;
+    std::vector<uint8_t> thread_stack(kThreadStackSize);
+    const auto mid = lines.begin() + lines.size() / 2;
+    SortRange first_half{lines.begin(), mid};
 
-        return a.length() < b.length();
-    };
-
-    std::sort(lines.begin(), lines.end(), comp);
+    auto [thread_id, err] = SyscallCreateThread(
+        SortThread, &first_half, &thread_stack[kThreadStackSize]);
+    if (err) {
+        std::sort(lines.begin(), lines.end(), LessLine);
+    } else {
+        std::sort(mid, lines.end(), LessLine);
+        SyscallJoinThread(thread_id);
+        std::inplace_merge(lines.begin(), mid, lines.end(), LessLine);
+    }
 
     for (auto& line : lines) {
         printf("%s", line.c_str());
     }
 
     exit(0);
-}
\ No newline at end of file
+}
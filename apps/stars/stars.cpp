@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <random>
 
+#include "../ring.h"
 #include "../syscall.h"
 
 static constexpr int kWidth = 100, kHeight = 100;
@@ -25,13 +26,15 @@ extern "C" void main(int argc, char** argv) {
     std::default_random_engine engine;
     std::uniform_int_distribution x_dist(0, kWidth - 2), y_dist(0, kHeight - 2);
 
+    // 星ごとにsyscallを呼ばず，リングに積んでまとめて描く
+    static SyscallBatch batch;
     for (int i = 0; i < num_stars; ++i) {
         const int x = x_dist(engine), y = y_dist(engine);
-        SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW, 4 + x, 24 + y, 2, 2,
-                                0xffffff);
+        batch.WinFillRectangle(layer_id | LAYER_NO_REDRAW, 4 + x, 24 + y, 2, 2,
+                               0xffffff);
     }
-
-    SyscallWinRedraw(layer_id);
+    batch.WinRedraw(layer_id);
+    batch.Flush();
 
     auto tick_end = SyscallGetCurrentTick();
     printf("%d stars in %lu ms.\n", num_stars,
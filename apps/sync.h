@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+#include "syscall.h"
+
+// 競合しない間はシステムコールを呼ばずにユーザモードだけで完結するMutex
+// state_ は 0: 未取得, 1: 取得済みで待ちなし, 2: 取得済みで待ちがいるかもしれない
+class Mutex {
+   public:
+    void Lock() {
+        uint32_t c = 0;
+        if (state_.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+            return;
+        }
+        if (c != 2) {
+            c = state_.exchange(2, std::memory_order_acquire);
+        }
+        while (c != 0) {
+            SyscallFutex(Addr(), FUTEX_WAIT, 2, 0, nullptr, 0);
+            c = state_.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    bool TryLock() {
+        uint32_t c = 0;
+        return state_.compare_exchange_strong(c, 1, std::memory_order_acquire);
+    }
+
+    void Unlock() {
+        if (state_.exchange(0, std::memory_order_release) == 2) {
+            SyscallFutex(Addr(), FUTEX_WAKE, 1, 0, nullptr, 0);
+        }
+    }
+
+   private:
+    std::atomic<uint32_t> state_{0};
+
+    uint32_t* Addr() { return reinterpret_cast<uint32_t*>(&state_); }
+
+    // CondVarから移されてきたスレッドは，待ちがいる前提で取得し直す
+    void LockContended() {
+        while (state_.exchange(2, std::memory_order_acquire) != 0) {
+            SyscallFutex(Addr(), FUTEX_WAIT, 2, 0, nullptr, 0);
+        }
+    }
+
+    friend class CondVar;
+};
+static_assert(sizeof(Mutex) == sizeof(uint32_t));
+
+// 通知のたびにseq_を進め，Waitは見た値から変わっていなければ眠る
+class CondVar {
+   public:
+    // mはロックした状態で呼ぶ．戻ったときもロックしている
+    void Wait(Mutex& m) {
+        const uint32_t seq = seq_.load(std::memory_order_relaxed);
+        m.Unlock();
+        SyscallFutex(Addr(), FUTEX_WAIT, seq, 0, nullptr, 0);
+        m.LockContended();
+    }
+
+    void Signal() {
+        seq_.fetch_add(1, std::memory_order_relaxed);
+        SyscallFutex(Addr(), FUTEX_WAKE, 1, 0, nullptr, 0);
+    }
+
+    // mはロックした状態で呼ぶ
+    // 全員を起こすとmの奪い合いになるので，1つだけ起こして残りはmの待ちへ移す
+    void Broadcast(Mutex& m) {
+        const uint32_t seq = seq_.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto [n, err] =
+            SyscallFutex(Addr(), FUTEX_CMP_REQUEUE, 1, INT_MAX, m.Addr(), seq);
+        if (err) {
+            // 途中で別の通知が割り込んだ．移さずに全員起こす
+            SyscallFutex(Addr(), FUTEX_WAKE, INT_MAX, 0, nullptr, 0);
+        }
+    }
+
+   private:
+    std::atomic<uint32_t> seq_{0};
+
+    uint32_t* Addr() { return reinterpret_cast<uint32_t*>(&seq_); }
+};
@@ -26,6 +26,12 @@ define_syscall OpenFile,         0x8000000c
 define_syscall ReadFile,         0x8000000d
 define_syscall DemandPages,      0x8000000e
 define_syscall MapFile,          0x8000000f
+define_syscall CancelTimer,      0x80000010
+define_syscall CreateThread,     0x80000011
+define_syscall JoinThread,       0x80000012
+define_syscall Futex,            0x80000013
+define_syscall OpenSharedMemory, 0x80000014
+define_syscall SubmitRing,       0x80000015
 
 
 
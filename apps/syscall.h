@@ -1,3 +1,5 @@
+#pragma once
+
 #ifdef __cplusplus
 #include <cstddef>
 #include <cstdint>
@@ -9,6 +11,7 @@ extern "C" {
 #endif
 
 #include "../kernel/app_event.hpp"
+#include "../kernel/syscall_ring.hpp"
 struct SyscallResult {
     uint64_t value;
     int error;
@@ -38,13 +41,42 @@ struct SyscallResult SyscallReadEvent(struct AppEvent* events, size_t len);
 #define TIMER_ONESHOT_ABS 0
 
 struct SyscallResult SyscallCreateTimer(unsigned int type, int timer_value,
-                                        unsigned long timeout_ms);
+                                        unsigned long timeout_ms,
+                                        uint64_t* timer_id);
+struct SyscallResult SyscallCancelTimer(uint64_t timer_id);
 
 struct SyscallResult SyscallOpenFile(const char* path, int flags);
 struct SyscallResult SyscallReadFile(int fd, void* buf, size_t count);
 struct SyscallResult SyscallDemandPages(size_t num_pages, int flags);
 struct SyscallResult SyscallMapFile(int fd, size_t* file_size, int flags);
 
+// entryはargを引数に呼ばれる．戻らずにSyscallExitでスレッドを終了すること
+// メインスレッドのSyscallExitはプロセス全体を終了する
+struct SyscallResult SyscallCreateThread(void (*entry)(void*), void* arg,
+                                         void* stack_top);
+struct SyscallResult SyscallJoinThread(uint64_t thread_id);
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 2
+#define FUTEX_CMP_REQUEUE 3
+
+// WAIT/WAKEではval2以降を使わない
+// REQUEUEはvalだけ起こし，最大val2個をaddr2へ移す
+// CMP_REQUEUEはさらに *addr == val3 のときだけ行う
+struct SyscallResult SyscallFutex(uint32_t* addr, int op, uint32_t val,
+                                  uint32_t val2, uint32_t* addr2,
+                                  uint32_t val3);
+
+// nameの共有メモリを割り当てたアドレスを返す．O_CREATなら無いときに*sizeバイトで作る
+// *sizeには実際の大きさが入る．同じ共有メモリ上のアドレスならFUTEXはプロセスをまたいで働く
+struct SyscallResult SyscallOpenSharedMemory(const char* name, size_t* size,
+                                             int flags);
+
+// ring->sqに積まれた要求を最大to_submit個まとめて実行し，実行した数を返す
+struct SyscallResult SyscallSubmitRing(struct SyscallRing* ring,
+                                       size_t to_submit);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
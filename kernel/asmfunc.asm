@@ -1,6 +1,43 @@
 bits 64
 section .text
 
+extern fpu_save_mode
+
+; 拡張状態をアドレス%1へ保存する．raxとrdxを壊す
+; fpu_save_mode 0: fxsave, 1: xsave, 2: xsaveopt
+; xsaveoptはその領域から直前にxrstorした場合だけ使う（%2 = 1）
+%macro save_fpu_state 2
+    cmp byte [fpu_save_mode], 0
+    je %%fx
+    mov eax, 0xffffffff
+    mov edx, eax
+%if %2
+    cmp byte [fpu_save_mode], 2
+    jne %%xs
+    xsaveopt %1
+    jmp %%done
+%endif
+%%xs:
+    xsave %1
+    jmp %%done
+%%fx:
+    fxsave %1
+%%done:
+%endmacro
+
+; アドレス%1から拡張状態を復帰する．raxとrdxを壊す
+%macro restore_fpu_state 1
+    cmp byte [fpu_save_mode], 0
+    je %%fx
+    mov eax, 0xffffffff
+    mov edx, eax
+    xrstor %1
+    jmp %%done
+%%fx:
+    fxrstor %1
+%%done:
+%endmacro
+
 
 extern kernel_main_stack
 extern KernelMainNewStack
@@ -57,6 +94,25 @@ SetCR3:
     mov cr3, rdi
     ret
 
+global GetCR4 ; uint64_t GetCR4();
+GetCR4:
+    mov rax, cr4
+    ret
+
+global SetCR4 ; void SetCR4(uint64_t value);
+SetCR4:
+    mov cr4, rdi
+    ret
+
+global SetXCR0 ; void SetXCR0(uint64_t value);
+SetXCR0:
+    mov rdx, rdi
+    shr rdx, 32
+    mov eax, edi
+    xor ecx, ecx
+    xsetbv
+    ret
+
 global IoOut32 ; void InOut32(uint16_t addr, uint32_t data);
 IoOut32:
     mov dx, di ; di = addr
@@ -142,7 +198,8 @@ SwitchContext:
     mov dx, gs
     mov [rsi + 0x38], rdx
 
-    fxsave [rsi + 0xc0]
+    ; 前回この領域から復帰しているので，変更のない部分は書き込まずに済む
+    save_fpu_state [rsi + 0xc0], 1
 
     push qword [rdi]
 
@@ -154,7 +211,7 @@ SwitchContext:
     push qword [rdi + 0x08] ; RIP
 
     ; コンテキストの復帰
-    fxrstor [rdi + 0xc0]
+    restore_fpu_state [rdi + 0xc0]
 
     mov rax, [rdi + 0x00]
     mov cr3, rax
@@ -190,7 +247,7 @@ RestoreContext: ; void RestoreContext(void* task_context);
     push qword [rdi + 0x20] ; CS
     push qword [rdi + 0x08] ; RIP
 
-    fxrstor [rdi + 0xc0]
+    restore_fpu_state [rdi + 0xc0]
     mov rax , [rdi + 0x00]
     mov cr3, rax
     mov rax, [rdi + 0x30]
@@ -219,7 +276,9 @@ RestoreContext: ; void RestoreContext(void* task_context);
 
 
 global CallApp
+global CallThread
 CallApp: ; void CallApp(int argc, char** argv, uint16_t cs, uint16_t ss, uint64_t rip, uint64_t rsp);
+CallThread: ; int CallThread(uint64_t arg, uint64_t unused, uint16_t ss, uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
     push rbx
     push rbp
     push r12
@@ -236,16 +295,21 @@ CallApp: ; void CallApp(int argc, char** argv, uint16_t cs, uint16_t ss, uint64_
     push rcx  ; RIP
     o64 retf
 
-extern LAPICTimerOnInterrupt
-; void LAPICTimerOnInterrupt(const TaskContext* ctx);
-
-global IntHandlerLAPICTimer
-IntHandlerLAPICTimer:
+; 割り込まれた時点のTaskContextをスタック上に作って%1へ渡す
+; %1はタスクを切り替えるときRestoreContextで戻り，ここへは帰ってこない
+%macro interrupt_with_context 1
     push rbp
     mov rbp, rsp
 
-    sub rsp, 512
-    fxsave [rsp]
+    ; xsaveの保存領域は64バイト境界に置く
+    sub rsp, 1024
+    and rsp, 0xffffffffffffffc0
+    push rax
+    push rdx
+    ; この領域は割り込みのたびに書き換わるのでxsaveoptは使えない
+    save_fpu_state [rsp + 16], 0
+    pop rdx
+    pop rax
     push r15
     push r14
     push r13
@@ -277,9 +341,10 @@ IntHandlerLAPICTimer:
     push rcx                ; CR3
 
     mov rdi, rsp
-    call LAPICTimerOnInterrupt
+    call %1
 
     add rsp, 8*8
+    restore_fpu_state [rsp + 16*8]
     pop rax
     pop rbx
     pop rcx
@@ -295,11 +360,25 @@ IntHandlerLAPICTimer:
     pop r13
     pop r14
     pop r15
-    fxrstor [rsp]
 
     mov rsp, rbp
     pop rbp
     iretq
+%endmacro
+
+extern LAPICTimerOnInterrupt
+; void LAPICTimerOnInterrupt(const TaskContext* ctx);
+
+global IntHandlerLAPICTimer
+IntHandlerLAPICTimer:
+    interrupt_with_context LAPICTimerOnInterrupt
+
+extern XHCIOnInterrupt
+; void XHCIOnInterrupt(const TaskContext* ctx);
+
+global IntHandlerXHCI
+IntHandlerXHCI:
+    interrupt_with_context XHCIOnInterrupt
 
 global LoadTR
 LoadTR:
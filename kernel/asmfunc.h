@@ -28,6 +28,13 @@ uint64_t GetCR2();
 
 uint64_t GetCR3();
 
+uint64_t GetCR4();
+
+void SetCR4(uint64_t value);
+
+// 拡張状態のうちxsaveで扱う部分を設定する
+void SetXCR0(uint64_t value);
+
 void SwitchContext(void *next_ctx, void *current_ctx);
 
 void RestoreContext(void *ctx);
@@ -35,8 +42,14 @@ void RestoreContext(void *ctx);
 int CallApp(int argc, char **argv, uint16_t ss, uint64_t rip, uint64_t rsp,
             uint64_t *os_stack_ptr);
 
+// CallAppと同じ処理．argをそのまま第1引数としてスレッドの入口へ渡す
+int CallThread(uint64_t arg, uint64_t unused, uint16_t ss, uint64_t rip,
+               uint64_t rsp, uint64_t *os_stack_ptr);
+
 void IntHandlerLAPICTimer();
 
+void IntHandlerXHCI();
+
 void LoadTR(uint16_t tr);
 
 void WriteMSR(uint32_t msr, uint64_t value);
@@ -0,0 +1,104 @@
+#include "compositor.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "latency.hpp"
+#include "layer.hpp"
+#include "message.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+// フレーム間隔．ティック単位に切り上げて，60Hzより細かくは合成しない
+const unsigned long kComposeInterval = (kTimerFreq + 59) / 60;
+const int kComposeTimerValue = 1;
+
+uint64_t compositor_task_id = 0;
+
+// 以下はlayer_mutexで保護する
+// 合成タスクへ依頼を送ってから，まだ合成していなければtrue
+bool compose_requested = false;
+// 次の合成で描画が画面へ反映されるタスク
+std::vector<uint64_t> pending_tasks;
+}  // namespace
+
+void RequestCompose(uint64_t task_id) {
+    ASSERT_LOCK_HELD(layer_mutex);
+    if (compositor_task_id == 0) {
+        layer_manager->Flush();
+        return;
+    }
+
+    if (task_id != 0 && std::find(pending_tasks.begin(), pending_tasks.end(),
+                                  task_id) == pending_tasks.end()) {
+        pending_tasks.push_back(task_id);
+    }
+
+    // 依頼済みなら，次の合成にまとめられる
+    if (compose_requested) {
+        return;
+    }
+    compose_requested = true;
+    task_manager->SendMessage(compositor_task_id, Message{Message::kCompose});
+}
+
+void TaskCompositor(uint64_t task_id, int64_t data) {
+    Task& task = task_manager->CurrentTask();
+    unsigned long next_frame_tick = 0;
+    bool timer_armed = false;
+    std::vector<uint64_t> updated_tasks;
+
+    while (true) {
+        auto msg = task.WaitMessage();
+        if (!msg) {
+            continue;
+        }
+
+        if (msg->type == Message::kTimerTimeout) {
+            timer_armed = false;
+        } else if (msg->type != Message::kCompose) {
+            continue;
+        }
+
+        const auto now = timer_manager->CurrentTick();
+        if (now < next_frame_tick) {
+            // 前のフレームから間がないので，次のフレームでまとめて描く
+            if (!timer_armed) {
+                const auto timer_id = timer_manager->AddTimer(
+                    Timer{next_frame_tick, kComposeTimerValue, task_id});
+                timer_armed = timer_id != kInvalidTimerID;
+            }
+            // タイマが取れなければ，合成が止まらないようにすぐ描く
+            if (timer_armed) {
+                continue;
+            }
+        }
+
+        {
+            ScopedLock lock{layer_mutex};
+            if (!compose_requested) {
+                continue;
+            }
+            compose_requested = false;
+            layer_manager->Flush();
+            updated_tasks.swap(pending_tasks);
+        }
+        next_frame_tick = now + kComposeInterval;
+
+        for (auto id : updated_tasks) {
+            RecordScreenUpdate(id);
+        }
+        updated_tasks.clear();
+    }
+}
+
+void InitializeCompositor() {
+    // 入力への反応を遅らせないよう，アプリケーションより高いレベルで動かす
+    Task& task = task_manager->NewTask().InitContext(TaskCompositor, 0);
+    {
+        ScopedLock lock{layer_mutex};
+        compositor_task_id = task.ID();
+    }
+    task_manager->Wakeup(&task, TaskManager::kBoostLevel);
+}
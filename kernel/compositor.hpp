@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// 画面の合成を受け持つタスク．back_buffer_と画面へ書き込むのはこのタスクだけ
+// 他のタスクはレイヤの再描画範囲を記録してRequestComposeを呼ぶ
+void TaskCompositor(uint64_t task_id, int64_t data);
+
+// layer_mutexを保持して呼ぶ．記録された範囲を次のフレームでまとめて描かせる
+// task_idを渡すと，そのタスクの描画が画面へ反映されたときに遅延を記録する
+// 合成タスクが動き出す前は，その場で画面へ写す
+void RequestCompose(uint64_t task_id = 0);
+
+void InitializeCompositor();
@@ -1,5 +1,6 @@
 #include "console.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 #include "font.hpp"
@@ -11,7 +12,9 @@ Console::Console(const PixelColor& fg_color, const PixelColor& bg_color)
       bg_color_{bg_color},
       buffer_{},
       cursor_row_{0},
-      cursor_column_{0} {}
+      cursor_column_{0},
+      layer_id_{0},
+      dirty_row_begin_{kRows} {}
 
 void Console::PutString(const char* s) {
     while (*s) {
@@ -29,13 +32,24 @@ void Console::PutString(const char* s) {
 
             buffer_[cursor_row_][cursor_column_] = *s;
             ++cursor_column_;
+            dirty_row_begin_ = std::min(dirty_row_begin_, cursor_row_);
         }
 
         ++s;
     }
 
-    if (layer_manager) {
-        layer_manager->Draw(layer_id_);
+    // printkは割り込みハンドラやロック保持中にも呼ばれるので待たない
+    // 描画できなかった分は次にこの領域を描画したときに反映される
+    if (layer_manager && layer_mutex.TryLock()) {
+        if (dirty_row_begin_ < kRows) {
+            const int top = kFontVerticalPixels * dirty_row_begin_;
+            layer_manager->Draw(
+                layer_id_, {{0, top},
+                            {kFontHorizonPixels * kColumns,
+                             kFontVerticalPixels * kRows - top}});
+            dirty_row_begin_ = kRows;
+        }
+        layer_mutex.Unlock();
     }
 }
 
@@ -70,13 +84,26 @@ void Console::NewLine() {
     }
 
     if (window_) {
-        Rectangle<int> move_src{
-            {0, kFontVerticalPixels},
-            {kFontHorizonPixels * kColumns, kFontVerticalPixels * (kRows - 1)}};
-        window_->Move({0, 0}, move_src);
+        // 画素をずらすのと，画面に写っている画素をずらす記録を同じロックの中で行う
+        // ロックを取れなければ，ずらした画素を全て描き直させる
+        if (layer_id_ != 0 && layer_manager && layer_mutex.TryLock()) {
+            const Rectangle<int> text_area{
+                {0, 0},
+                {kFontHorizonPixels * kColumns, kFontVerticalPixels * kRows}};
+            layer_manager->Scroll(layer_id_, text_area, -kFontVerticalPixels);
+            layer_mutex.Unlock();
+        } else {
+            Rectangle<int> move_src{{0, kFontVerticalPixels},
+                                    {kFontHorizonPixels * kColumns,
+                                     kFontVerticalPixels * (kRows - 1)}};
+            window_->Move({0, 0}, move_src);
+            dirty_row_begin_ = 0;
+        }
         FillRectangle(*drawer_, {0, kFontVerticalPixels * (kRows - 1)},
                       {kFontHorizonPixels * kColumns, kFontVerticalPixels},
                       bg_color_);
+        // 書き換えた行も一緒に上へずれ，最下行は新しく書き換えたことになる
+        dirty_row_begin_ = std::max(dirty_row_begin_ - 1, 0);
     } else {
         FillRectangle(
             *drawer_, {0, 0},
@@ -92,6 +119,7 @@ void Console::NewLine() {
 }
 
 void Console::Refresh() {
+    dirty_row_begin_ = 0;
     for (int row = 0; row < kRows; ++row) {
         WriteString(*drawer_, Vector2D<int>{0, kFontVerticalPixels * row},
                     buffer_[row], fg_color_);
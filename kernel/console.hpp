@@ -24,6 +24,8 @@ class Console {
     char buffer_[kRows][kColumns + 1];
     int cursor_row_, cursor_column_;
     unsigned int layer_id_;
+    // まだ画面へ写していない，最も上の行
+    int dirty_row_begin_;
 };
 
 extern Console* console;
@@ -1,39 +1,48 @@
 #include "drawing.hpp"
 
-void RGB8BitScreenDrawer::Draw(Vector2D<int> pos, const PixelColor& c) {
-    auto target_pixel = PixelAt(pos);
-    target_pixel[0] = c.r;
-    target_pixel[1] = c.g;
-    target_pixel[2] = c.b;
+void ScreenDrawer::FillSpan(Vector2D<int> pos, int len, const PixelColor& c) {
+    for (int dx = 0; dx < len; ++dx) {
+        Draw(pos + Vector2D<int>{dx, 0}, c);
+    }
 }
 
-void BGR8BitScreenDrawer::Draw(Vector2D<int> pos, const PixelColor& c) {
-    auto target_pixel = PixelAt(pos);
-    target_pixel[0] = c.b;
-    target_pixel[1] = c.g;
-    target_pixel[2] = c.r;
+void ScreenDrawer::FillRect(Vector2D<int> pos, Vector2D<int> size,
+                            const PixelColor& c) {
+    for (int dy = 0; dy < size.y; ++dy) {
+        FillSpan(pos + Vector2D<int>{0, dy}, size.x, c);
+    }
 }
 
-void FillRectangle(ScreenDrawer& drawer, const Vector2D<int>& pos,
-                   const Vector2D<int>& area, const PixelColor& c) {
-    for (int dy = 0; dy < area.y; ++dy) {
-        for (int dx = 0; dx < area.x; ++dx) {
-            drawer.Draw(pos + Vector2D<int>{dx, dy}, c);
+void ScreenDrawer::BlitRow(Vector2D<int> pos, const PixelColor* colors,
+                           int len) {
+    for (int dx = 0; dx < len; ++dx) {
+        Draw(pos + Vector2D<int>{dx, 0}, colors[dx]);
+    }
+}
+
+void ScreenDrawer::BlitMask(Vector2D<int> pos, const uint8_t* mask, int pitch,
+                            Vector2D<int> size, const PixelColor& c) {
+    for (int dy = 0; dy < size.y; ++dy) {
+        const uint8_t* bits = mask + pitch * dy;
+        for (int dx = 0; dx < size.x; ++dx) {
+            if (bits[dx >> 3] & (0x80u >> (dx & 7))) {
+                Draw(pos + Vector2D<int>{dx, dy}, c);
+            }
         }
     }
 }
 
-void DrawRectangle(ScreenDrawer& drawer, const Vector2D<int>& pos,
+void FillRectangle(ScreenDrawer& drawer, const Vector2D<int>& pos,
                    const Vector2D<int>& area, const PixelColor& c) {
-    for (int dx = 0; dx < area.x; ++dx) {
-        drawer.Draw(pos + Vector2D<int>{dx, 0}, c);
-        drawer.Draw(pos + Vector2D<int>{0, area.y - 1}, c);
-    }
+    drawer.FillRect(pos, area, c);
+}
 
-    for (int dy = 1; dy < area.y - 1; ++dy) {
-        drawer.Draw(pos + Vector2D<int>{0, dy}, c);
-        drawer.Draw(pos + Vector2D<int>{area.x - 1, dy}, c);
-    }
+void DrawRectangle(ScreenDrawer& drawer, const Vector2D<int>& pos,
+                   const Vector2D<int>& area, const PixelColor& c) {
+    drawer.FillSpan(pos, area.x, c);
+    drawer.FillSpan(pos + Vector2D<int>{0, area.y - 1}, area.x, c);
+    drawer.FillRect(pos + Vector2D<int>{0, 1}, {1, area.y - 2}, c);
+    drawer.FillRect(pos + Vector2D<int>{area.x - 1, 1}, {1, area.y - 2}, c);
 }
 
 void DrawDesktop(ScreenDrawer& drawer) {
@@ -3,6 +3,7 @@
 #include <algorithm>
 
 #include "frame_buffer_config.hpp"
+#include "pixel_kernel.hpp"
 
 struct PixelColor {
     uint8_t r, g, b;
@@ -76,7 +77,7 @@ Rectangle<T> operator&(const Rectangle<T> &lhs, const Rectangle<U> &rhs) {
     const auto rhs_end = rhs.pos + rhs.size;
 
     if (lhs_end.x < rhs.pos.x || lhs_end.y < rhs.pos.y ||
-        rhs_end.x < lhs.pos.x || rhs_end.y < rhs.pos.y) {
+        rhs_end.x < lhs.pos.x || rhs_end.y < lhs.pos.y) {
         return {{0, 0}, {0, 0}};
     }
 
@@ -92,6 +93,18 @@ class ScreenDrawer {
     virtual void Draw(Vector2D<int> pos, const PixelColor &c) = 0;
     virtual int Width() const = 0;
     virtual int Height() const = 0;
+
+    // まとめて描く操作．既定の実装はDrawを繰り返すので，速く描ける描画先は上書きする
+    // posから右へlen画素を塗る
+    virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor &c);
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size,
+                          const PixelColor &c);
+    // posから右へcolorsのlen画素を並べる
+    virtual void BlitRow(Vector2D<int> pos, const PixelColor *colors, int len);
+    // 1画素1ビットのmaskのうち，ビットが立っている画素だけを塗る
+    // 各行は上位ビットから並び，次の行はpitchバイト先から始まる
+    virtual void BlitMask(Vector2D<int> pos, const uint8_t *mask, int pitch,
+                          Vector2D<int> size, const PixelColor &c);
 };
 
 class FrameBufferDrawer : public ScreenDrawer {
@@ -100,31 +113,119 @@ class FrameBufferDrawer : public ScreenDrawer {
     virtual ~FrameBufferDrawer() = default;
     virtual int Width() const override { return config_.horizontal_resolution; }
     virtual int Height() const override { return config_.vertical_resolution; }
+    // 書き込まれている画素を読み出す
+    virtual PixelColor At(Vector2D<int> pos) const = 0;
 
    protected:
-    uint8_t *PixelAt(Vector2D<int> pos) {
+    uint8_t *PixelAt(Vector2D<int> pos) const {
         return config_.frame_buffer +
                4 * (config_.pixels_per_scan_line * pos.y + pos.x);
     }
 
+    uint32_t *RowAt(Vector2D<int> pos) const {
+        return reinterpret_cast<uint32_t *>(PixelAt(pos));
+    }
+
+    // 描く範囲を画面内に切り詰める．描く画素が残らなければfalse
+    bool Clip(Vector2D<int> &pos, Vector2D<int> &size) const {
+        const auto end = ElementMin(pos + size, Vector2D<int>{Width(), Height()});
+        pos = ElementMax(pos, Vector2D<int>{0, 0});
+        size = end - pos;
+        return size.x > 0 && size.y > 0;
+    }
+
    private:
     const FrameBufferConfig &config_;
 };
 
-class RGB8BitScreenDrawer : public FrameBufferDrawer {
+// 画素形式ごとの変換をインライン展開し，行単位でまとめて書き込む
+template <PixelFormat kFormat>
+class PixelFormatDrawer : public FrameBufferDrawer {
    public:
     using FrameBufferDrawer::FrameBufferDrawer;
 
-    virtual void Draw(Vector2D<int> pos, const PixelColor &c) override;
-};
+    static uint32_t Pack(const PixelColor &c) {
+        if constexpr (kFormat == kPixelRGBResv8BitPerColor) {
+            return c.r | c.g << 8 | c.b << 16;
+        } else {
+            return c.b | c.g << 8 | c.r << 16;
+        }
+    }
 
-class BGR8BitScreenDrawer : public FrameBufferDrawer {
-   public:
-    using FrameBufferDrawer::FrameBufferDrawer;
+    static PixelColor Unpack(uint32_t v) {
+        const uint8_t lo = v, mid = v >> 8, hi = v >> 16;
+        if constexpr (kFormat == kPixelRGBResv8BitPerColor) {
+            return {lo, mid, hi};
+        } else {
+            return {hi, mid, lo};
+        }
+    }
+
+    virtual void Draw(Vector2D<int> pos, const PixelColor &c) override {
+        *RowAt(pos) = Pack(c);
+    }
 
-    virtual void Draw(Vector2D<int> pos, const PixelColor &c) override;
+    virtual PixelColor At(Vector2D<int> pos) const override {
+        return Unpack(*RowAt(pos));
+    }
+
+    virtual void FillSpan(Vector2D<int> pos, int len,
+                          const PixelColor &c) override {
+        FillRect(pos, {len, 1}, c);
+    }
+
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size,
+                          const PixelColor &c) override {
+        if (!Clip(pos, size)) {
+            return;
+        }
+
+        const uint32_t v = Pack(c);
+        for (int y = 0; y < size.y; ++y) {
+            FillPixels(RowAt(pos + Vector2D<int>{0, y}), size.x, v);
+        }
+    }
+
+    virtual void BlitRow(Vector2D<int> pos, const PixelColor *colors,
+                         int len) override {
+        const auto orig = pos;
+        Vector2D<int> size{len, 1};
+        if (!Clip(pos, size)) {
+            return;
+        }
+
+        colors += pos.x - orig.x;
+        uint32_t *row = RowAt(pos);
+        for (int x = 0; x < size.x; ++x) {
+            row[x] = Pack(colors[x]);
+        }
+    }
+
+    virtual void BlitMask(Vector2D<int> pos, const uint8_t *mask, int pitch,
+                          Vector2D<int> size, const PixelColor &c) override {
+        const auto orig = pos;
+        if (!Clip(pos, size)) {
+            return;
+        }
+
+        const uint32_t v = Pack(c);
+        const auto skip = pos - orig;
+        for (int y = 0; y < size.y; ++y) {
+            const uint8_t *bits = mask + pitch * (skip.y + y);
+            uint32_t *row = RowAt(pos + Vector2D<int>{0, y});
+            for (int x = 0; x < size.x; ++x) {
+                const int bx = skip.x + x;
+                if (bits[bx >> 3] & (0x80u >> (bx & 7))) {
+                    row[x] = v;
+                }
+            }
+        }
+    }
 };
 
+using RGB8BitScreenDrawer = PixelFormatDrawer<kPixelRGBResv8BitPerColor>;
+using BGR8BitScreenDrawer = PixelFormatDrawer<kPixelBGRResv8BitPerColor>;
+
 void FillRectangle(ScreenDrawer &drawer, const Vector2D<int> &position,
                    const Vector2D<int> &area, const PixelColor &c);
 
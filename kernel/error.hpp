@@ -35,6 +35,8 @@ class Error {
         kIsDirectory,
         kNoSuchEntry,
         kFreeTypeError,
+        kTryAgain,
+        kInterrupted,
         kLastOfCode,  // この列挙子は常に最後に配置する
     };
 
@@ -69,6 +71,8 @@ class Error {
         "kIsDirectory",
         "kNoSuchEntry",
         "kFreeTypeError",
+        "kTryAgain",
+        "kInterrupted",
     };
     static_assert(Error::Code::kLastOfCode == code_names_.size());
 
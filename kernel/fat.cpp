@@ -332,7 +332,7 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
         }
 
         uint8_t* sector = GetSectorByCluster<uint8_t>(wr_cluster_);
-        size_t n = std::min(len, bytes_per_cluster - wr_cluster_off_);
+        size_t n = std::min(len - total, bytes_per_cluster - wr_cluster_off_);
         memcpy(&sector[wr_cluster_off_], &buf8[total], n);
         total += n;
         wr_cluster_off_ += n;
@@ -343,6 +343,29 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
     return total;
 }
 
+std::optional<FileSpan> FileDescriptor::ReadSpan(size_t len) {
+    if (rd_cluster_ == 0) {
+        rd_cluster_ = fat_entry_.FirstCluster();
+    }
+
+    len = std::min({len, fat_entry_.file_size - rd_off_,
+                    bytes_per_cluster - rd_cluster_off_});
+    if (len == 0) {
+        return FileSpan{nullptr, 0};
+    }
+
+    const uint8_t* sector = GetSectorByCluster<uint8_t>(rd_cluster_);
+    FileSpan span{&sector[rd_cluster_off_], len};
+
+    rd_off_ += len;
+    rd_cluster_off_ += len;
+    if (rd_cluster_off_ == bytes_per_cluster) {
+        rd_cluster_ = NextCluster(rd_cluster_);
+        rd_cluster_off_ = 0;
+    }
+    return span;
+}
+
 size_t FileDescriptor::Load(void* buf, size_t len, size_t offset) {
     FileDescriptor fd{fat_entry_};
     fd.rd_off_ = offset;
@@ -113,6 +113,8 @@ class FileDescriptor : public ::FileDescriptor {
     size_t Write(const void* buf, size_t len) override;
     size_t Size() const override { return fat_entry_.file_size; }
     size_t Load(void* buf, size_t len, size_t offset) override;
+    // ボリュームイメージ内のクラスタを直接指す範囲を返す
+    std::optional<FileSpan> ReadSpan(size_t len) override;
 
    private:
     // ファイルへの参照
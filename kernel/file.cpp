@@ -1,5 +1,6 @@
 #include "file.hpp"
 
+#include <algorithm>
 #include <cstdio>
 
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...) {
@@ -30,4 +31,36 @@ size_t ReadDelim(FileDescriptor& fd, char delim, char* buf, size_t len) {
 
     buf[i] = '\0';
     return i;
+}
+
+size_t SpliceFD(FileDescriptor& dst, FileDescriptor& src, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        if (auto span = src.ReadSpan(len - total)) {
+            if (span->len == 0) {
+                break;
+            }
+
+            const size_t written = dst.Write(span->data, span->len);
+            total += written;
+            if (written < span->len) {
+                break;
+            }
+            continue;
+        }
+
+        char buf[1024];
+        const size_t read = src.Read(buf, std::min(len - total, sizeof(buf)));
+        if (read == 0) {
+            break;
+        }
+
+        const size_t written = dst.Write(buf, read);
+        total += written;
+        if (written < read) {
+            break;
+        }
+    }
+
+    return total;
 }
\ No newline at end of file
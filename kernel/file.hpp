@@ -1,9 +1,17 @@
 #pragma once
 
 #include <cstddef>
+#include <limits>
+#include <optional>
 
 #include "error.hpp"
 
+// コピーせずに読み出せるデータの範囲
+struct FileSpan {
+    const void* data;
+    size_t len;
+};
+
 class FileDescriptor {
    public:
     virtual ~FileDescriptor() = default;
@@ -11,7 +19,14 @@ class FileDescriptor {
     virtual size_t Write(const void* buf, size_t len) = 0;
     virtual size_t Size() const = 0;
     virtual size_t Load(void* buf, size_t len, size_t offset);
+    // 読み込み位置のデータを指す範囲を返し，その分だけ読み込み位置を進める
+    // 範囲の長さはlen以下で，0なら終端．コピーせずに読めなければnulloptを返す
+    virtual std::optional<FileSpan> ReadSpan(size_t len) { return std::nullopt; }
 };
 
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...);
 size_t ReadDelim(FileDescriptor& fd, char delim, char* buf, size_t len);
+// srcの終端まで，または最大lenバイトをdstへ移し，移したバイト数を返す
+// srcがReadSpanに対応していれば，途中のバッファを経由せずにdstへ直接書き込む
+size_t SpliceFD(FileDescriptor& dst, FileDescriptor& src,
+                size_t len = std::numeric_limits<size_t>::max());
@@ -1,9 +1,15 @@
 #include "font.hpp"
 
+#include <array>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <tuple>
 #include <vector>
 
 #include "fat.hpp"
+#include "lock.hpp"
 
 extern const uint8_t _binary_hankaku_bin_start;
 extern const uint8_t _binary_hankaku_bin_end;
@@ -21,6 +27,98 @@ const uint8_t* GetFont(char c) {
 
 FT_Library ft_library;
 std::vector<uint8_t>* nihongo_buf;
+// 起動時に1度だけ作り，以降は使い回す
+FT_Face nihongo_face;
+
+const int kGlyphPixelSize = 16;
+const FT_Int32 kGlyphLoadFlags = FT_LOAD_RENDER | FT_LOAD_TARGET_MONO;
+// キャッシュに入れるビットマップの最大の幅と高さ．はみ出す部分は捨てる
+const int kMaxGlyphPixels = 32;
+const int kMaxGlyphPitch = kMaxGlyphPixels / 8;
+
+struct GlyphKey {
+    char32_t code;
+    int pixel_size;
+    FT_Int32 load_flags;
+};
+
+bool operator<(const GlyphKey& lhs, const GlyphKey& rhs) {
+    return std::tie(lhs.code, lhs.pixel_size, lhs.load_flags) <
+           std::tie(rhs.code, rhs.pixel_size, rhs.load_flags);
+}
+
+// FreeTypeで描いたグリフの1bppのビットマップ
+struct Glyph {
+    GlyphKey key;
+    // フォントにない文字ならfalse
+    bool found;
+    // 文字を描く位置から見たビットマップの左上
+    Vector2D<int> topleft;
+    Vector2D<int> size;
+    // 各行は上位ビットから並ぶ．BlitMaskにそのまま渡せる
+    std::array<uint8_t, kMaxGlyphPitch * kMaxGlyphPixels> mask;
+    // LRUの双方向リスト
+    int prev, next;
+};
+
+// 描いたグリフを覚えておき，同じ文字を描くたびにFreeTypeを呼ばないようにする
+// 満杯になったら最も長く使われていないグリフを追い出す
+class GlyphCache {
+   public:
+    static const int kCapacity = 256;
+
+    // 見つかったグリフは最近使ったものにする．なければnullptr
+    Glyph* Find(const GlyphKey& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        Unlink(it->second);
+        PushFront(it->second);
+        return &glyphs_[it->second];
+    }
+
+    // keyのグリフを置く場所を空けて返す．中身は呼び出し側が埋める
+    Glyph& Insert(const GlyphKey& key) {
+        int i;
+        if (used_ < kCapacity) {
+            i = used_++;
+        } else {
+            i = tail_;
+            Unlink(i);
+            index_.erase(glyphs_[i].key);
+        }
+
+        glyphs_[i].key = key;
+        index_[key] = i;
+        PushFront(i);
+        return glyphs_[i];
+    }
+
+   private:
+    std::array<Glyph, kCapacity> glyphs_;
+    std::map<GlyphKey, int> index_{};
+    // 先頭が最近使ったもの
+    int head_{-1}, tail_{-1};
+    int used_{0};
+
+    void Unlink(int i) {
+        auto& g = glyphs_[i];
+        (g.prev >= 0 ? glyphs_[g.prev].next : head_) = g.next;
+        (g.next >= 0 ? glyphs_[g.next].prev : tail_) = g.prev;
+    }
+
+    void PushFront(int i) {
+        glyphs_[i].prev = -1;
+        glyphs_[i].next = head_;
+        (head_ >= 0 ? glyphs_[head_].prev : tail_) = i;
+        head_ = i;
+    }
+};
+
+GlyphCache* glyph_cache;
+// nihongo_faceとglyph_cacheを使う間は保持する
+Mutex font_mutex;
 
 Error RenderUnicode(char32_t c, FT_Face face) {
     const auto glyph_index = FT_Get_Char_Index(face, c);
@@ -28,13 +126,43 @@ Error RenderUnicode(char32_t c, FT_Face face) {
         return MAKE_ERROR(Error::kFreeTypeError);
     }
 
-    if (int err = FT_Load_Glyph(face, glyph_index,
-                                FT_LOAD_RENDER | FT_LOAD_TARGET_MONO)) {
+    if (int err = FT_Load_Glyph(face, glyph_index, kGlyphLoadFlags)) {
         return MAKE_ERROR(Error::kFreeTypeError);
     }
 
     return MAKE_ERROR(Error::kSuccess);
 }
+
+// nihongo_faceで描いたグリフをglyphへ写す
+Error RenderGlyph(const GlyphKey& key, Glyph& glyph) {
+    glyph.found = false;
+    if (auto err = RenderUnicode(key.code, nihongo_face)) {
+        return err;
+    }
+
+    const FT_Face face = nihongo_face;
+    const FT_Bitmap& bitmap = face->glyph->bitmap;
+    const int baseline = (face->height + face->descender) *
+                         face->size->metrics.y_ppem / face->units_per_EM;
+    glyph.topleft = {face->glyph->bitmap_left,
+                     baseline - face->glyph->bitmap_top};
+    glyph.size = {std::min(static_cast<int>(bitmap.width), kMaxGlyphPixels),
+                  std::min(static_cast<int>(bitmap.rows), kMaxGlyphPixels)};
+
+    // pitchが負のときはbufferが最下行を指すので，最上行まで戻す
+    const uint8_t* mask = bitmap.buffer;
+    if (bitmap.pitch < 0) {
+        mask -= bitmap.pitch * (static_cast<int>(bitmap.rows) - 1);
+    }
+
+    const int bytes = (glyph.size.x + 7) / 8;
+    for (int y = 0; y < glyph.size.y; ++y) {
+        memcpy(&glyph.mask[kMaxGlyphPitch * y], mask + bitmap.pitch * y,
+               bytes);
+    }
+    glyph.found = true;
+    return MAKE_ERROR(Error::kSuccess);
+}
 }  // namespace
 
 void WriteAscii(ScreenDrawer& drawer, Vector2D<int> pos, char c,
@@ -44,13 +172,8 @@ void WriteAscii(ScreenDrawer& drawer, Vector2D<int> pos, char c,
         return;
     }
 
-    for (int dy = 0; dy < kFontVerticalPixels; ++dy) {
-        for (int dx = 0; dx < kFontHorizonPixels; ++dx) {
-            if ((font[dy] << dx) & 0x80u) {
-                drawer.Draw(pos + Vector2D<int>{dx, dy}, color);
-            }
-        }
-    }
+    drawer.BlitMask(pos, font, 1, {kFontHorizonPixels, kFontVerticalPixels},
+                    color);
 }
 
 void WriteString(ScreenDrawer& drawer, Vector2D<int> pos, const char s[],
@@ -61,7 +184,7 @@ void WriteString(ScreenDrawer& drawer, Vector2D<int> pos, const char s[],
         WriteUnicode(drawer, pos + Vector2D<int>{kFontHorizonPixels * x, 0},
                      u32, color);
         s += bytes;
-        x += IsHankaku(32) ? 1 : 2;
+        x += IsHankaku(u32) ? 1 : 2;
     }
 }
 
@@ -115,7 +238,7 @@ WithError<FT_Face> NewFTFace() {
         return {face, MAKE_ERROR(Error::kFreeTypeError)};
     }
 
-    if (int err = FT_Set_Pixel_Sizes(face, 16, 16)) {
+    if (int err = FT_Set_Pixel_Sizes(face, kGlyphPixelSize, kGlyphPixelSize)) {
         return {face, MAKE_ERROR(Error::kFreeTypeError)};
     }
 
@@ -130,42 +253,25 @@ Error WriteUnicode(ScreenDrawer& drawer, Vector2D<int> pos, char32_t c,
         return MAKE_ERROR(Error::kSuccess);
     }
 
-    auto [face, err] = NewFTFace();
-    if (err) {
-        WriteAscii(drawer, pos, '?', color);
-        WriteAscii(drawer, pos + Vector2D<int>{kFontHorizonPixels, 0}, '?',
-                   color);
-        return err;
+    ScopedLock lock{font_mutex};
+    const GlyphKey key{c, kGlyphPixelSize, kGlyphLoadFlags};
+    Glyph* glyph = glyph_cache->Find(key);
+    Error err = MAKE_ERROR(Error::kSuccess);
+    if (glyph == nullptr) {
+        // フォントにない文字も覚えておき，次からはFreeTypeを呼ばない
+        glyph = &glyph_cache->Insert(key);
+        err = RenderGlyph(key, *glyph);
     }
 
-    if (auto err = RenderUnicode(c, face)) {
-        FT_Done_Face(face);
+    if (!glyph->found) {
         WriteAscii(drawer, pos, '?', color);
-        WriteAscii(drawer, pos + Vector2D<int>{8, 0}, '?', color);
-        return err;
-    }
-
-    FT_Bitmap& bitmap = face->glyph->bitmap;
-    const int baseline = (face->height + face->descender) *
-                         face->size->metrics.y_ppem / face->units_per_EM;
-    const auto glyph_topleft =
-        pos + Vector2D<int>{face->glyph->bitmap_left,
-                            baseline - face->glyph->bitmap_top};
-
-    for (int dy = 0; dy < bitmap.rows; ++dy) {
-        unsigned char* q = &bitmap.buffer[bitmap.pitch * dy];
-        if (bitmap.pitch < 0) {
-            q -= bitmap.pitch * bitmap.rows;
-        }
-        for (int dx = 0; dx < bitmap.width; ++dx) {
-            const bool b = q[dx >> 3] & (0x80 >> (dx & 0x7));
-            if (b) {
-                drawer.Draw(glyph_topleft + Vector2D<int>{dx, dy}, color);
-            }
-        }
+        WriteAscii(drawer, pos + Vector2D<int>{kFontHorizonPixels, 0}, '?',
+                   color);
+        return err ? err : MAKE_ERROR(Error::kFreeTypeError);
     }
 
-    FT_Done_Face(face);
+    drawer.BlitMask(pos + glyph->topleft, glyph->mask.data(), kMaxGlyphPitch,
+                    glyph->size, color);
     return MAKE_ERROR(Error::kSuccess);
 }
 
@@ -186,4 +292,11 @@ void InitializeFont() {
         delete nihongo_buf;
         exit(1);
     }
+
+    auto [face, err] = NewFTFace();
+    if (err) {
+        exit(1);
+    }
+    nihongo_face = face;
+    glyph_cache = new GlyphCache;
 }
\ No newline at end of file
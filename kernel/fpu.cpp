@@ -0,0 +1,51 @@
+#include "fpu.hpp"
+
+#include <cpuid.h>
+
+#include <cstdint>
+
+#include "asmfunc.h"
+#include "logger.hpp"
+
+// asmfunc.asmが参照する 0: fxsave, 1: xsave, 2: xsaveopt
+extern "C" uint8_t fpu_save_mode = 0;
+
+namespace {
+const uint64_t kCR4OSXSAVE = 1u << 18;
+
+const uint64_t kXCR0X87 = 1u << 0;
+const uint64_t kXCR0SSE = 1u << 1;
+const uint64_t kXCR0AVX = 1u << 2;
+
+bool avx_enabled = false;
+}  // namespace
+
+bool FPUAVXEnabled() { return avx_enabled; }
+
+void InitializeFPU() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_XSAVE)) {
+        Log(kWarn, "XSAVE is not supported. use FXSAVE\n");
+        return;
+    }
+
+    SetCR4(GetCR4() | kCR4OSXSAVE);
+    uint64_t xcr0 = kXCR0X87 | kXCR0SSE;
+    if (ecx & bit_AVX) {
+        xcr0 |= kXCR0AVX;
+    }
+    SetXCR0(xcr0);
+
+    // EBXは現在XCR0で有効な機能の保存に必要な大きさ
+    __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+    if (ebx > kFPUAreaSize) {
+        xcr0 = kXCR0X87 | kXCR0SSE;
+        SetXCR0(xcr0);
+    }
+
+    avx_enabled = xcr0 & kXCR0AVX;
+
+    __cpuid_count(0xd, 1, eax, ebx, ecx, edx);
+    fpu_save_mode = (eax & bit_XSAVEOPT) ? 2 : 1;
+    Log(kInfo, "FPU state: xcr0 = %lx, mode = %d\n", xcr0, fpu_save_mode);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// TaskContextに置く拡張状態の保存領域の大きさ x87, SSE, AVXの状態が収まる
+const size_t kFPUAreaSize = 1024;
+
+// 使えればxsave/xsaveoptで拡張状態を保存するように設定する
+// 最初のコンテキストスイッチと割り込みより前に呼ぶこと
+void InitializeFPU();
+
+// AVXの状態をコンテキストスイッチで保存するように設定できていればtrue
+bool FPUAVXEnabled();
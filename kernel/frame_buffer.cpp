@@ -1,5 +1,7 @@
 #include "frame_buffer.hpp"
 
+#include "pixel_kernel.hpp"
+
 namespace {
 int BytesPerPixels(PixelFormat format) {
     switch (format) {
@@ -26,6 +28,32 @@ Vector2D<int> FrameBufferSize(const FrameBufferConfig& config) {
     return {static_cast<int>(config.horizontal_resolution),
             static_cast<int>(config.vertical_resolution)};
 }
+
+// srcのsrc_areaをdstのdst_posへ写すとき，両方に収まる部分を1行ずつfへ渡す
+template <class RowFunc>
+void ForEachCopyRow(const FrameBufferConfig& dst, Vector2D<int> dst_pos,
+                    const FrameBufferConfig& src,
+                    const Rectangle<int>& src_area, RowFunc f) {
+    const Rectangle<int> src_area_shifted{dst_pos, src_area.size};
+    const Rectangle<int> src_outline{dst_pos - src_area.pos,
+                                     FrameBufferSize(src)};
+    const Rectangle<int> dst_outline{{0, 0}, FrameBufferSize(dst)};
+    const auto copy_area = dst_outline & src_outline & src_area_shifted;
+    if (copy_area.size.x <= 0 || copy_area.size.y <= 0) {
+        return;
+    }
+    const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
+
+    uint8_t* dst_buf = FrameAddrAt(copy_area.pos, dst);
+    const uint8_t* src_buf = FrameAddrAt(src_start_pos, src);
+
+    for (int y = 0; y < copy_area.size.y; ++y) {
+        f(reinterpret_cast<uint32_t*>(dst_buf),
+          reinterpret_cast<const uint32_t*>(src_buf), copy_area.size.x);
+        dst_buf += BytesPerScanLine(dst);
+        src_buf += BytesPerScanLine(src);
+    }
+}
 }  // namespace
 
 Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
@@ -39,10 +67,14 @@ Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
     if (config_.frame_buffer) {
         buffer_.resize(0);
     } else {
-        buffer_.resize(bytes_per_pixel * config_.horizontal_resolution *
+        // 1行の長さを64バイトの倍数に切り上げる
+        const uint32_t pixels_per_line = sizeof(CacheLine) / bytes_per_pixel;
+        config_.pixels_per_scan_line =
+            (config_.horizontal_resolution + pixels_per_line - 1) /
+            pixels_per_line * pixels_per_line;
+        buffer_.resize(BytesPerScanLine(config_) / sizeof(CacheLine) *
                        config_.vertical_resolution);
-        config_.frame_buffer = buffer_.data();
-        config_.pixels_per_scan_line = config_.horizontal_resolution;
+        config_.frame_buffer = reinterpret_cast<uint8_t*>(buffer_.data());
     }
 
     switch (config_.pixel_format) {
@@ -61,31 +93,48 @@ Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
 
 Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
                         const Rectangle<int>& src_area) {
-    if (config_.pixel_format != src.config_.pixel_format) {
+    if (BytesPerPixels(config_.pixel_format) <= 0 ||
+        BytesPerPixels(src.config_.pixel_format) <= 0) {
         return MAKE_ERROR(Error::kUnknownPixelFormat);
     }
 
-    const auto bytes_per_pixel = BytesPerPixels(config_.pixel_format);
-    if (bytes_per_pixel <= 0) {
-        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    if (config_.pixel_format == src.config_.pixel_format) {
+        ForEachCopyRow(config_, dst_pos, src.config_, src_area,
+                       [](uint32_t* dst, const uint32_t* src, int n) {
+                           memcpy(dst, src, sizeof(uint32_t) * n);
+                       });
+    } else {
+        // RGBとBGRの間は並べ替えながら写す
+        ForEachCopyRow(config_, dst_pos, src.config_, src_area, SwizzlePixels);
     }
 
-    const Rectangle<int> src_area_shifted{dst_pos, src_area.size};
-    const Rectangle<int> src_outline{dst_pos - src_area.pos,
-                                     FrameBufferSize(src.config_)};
-    const Rectangle<int> dst_outline{{0, 0}, FrameBufferSize(config_)};
-    const auto copy_area = dst_outline & src_outline & src_area_shifted;
-    const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
+    return MAKE_ERROR(Error::kSuccess);
+}
 
-    uint8_t* dst_buf = FrameAddrAt(copy_area.pos, config_);
-    const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
+Error FrameBuffer::CopyTransparent(Vector2D<int> dst_pos,
+                                   const FrameBuffer& src,
+                                   const Rectangle<int>& src_area,
+                                   const PixelColor& transparent) {
+    if (config_.pixel_format != src.config_.pixel_format) {
+        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    }
 
-    for (int y = 0; y < copy_area.size.y; ++y) {
-        memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
-        dst_buf += BytesPerScanLine(config_);
-        src_buf += BytesPerScanLine(src.config_);
+    uint32_t key;
+    switch (config_.pixel_format) {
+        case kPixelRGBResv8BitPerColor:
+            key = RGB8BitScreenDrawer::Pack(transparent);
+            break;
+        case kPixelBGRResv8BitPerColor:
+            key = BGR8BitScreenDrawer::Pack(transparent);
+            break;
+        default:
+            return MAKE_ERROR(Error::kUnknownPixelFormat);
     }
 
+    ForEachCopyRow(config_, dst_pos, src.config_, src_area,
+                   [key](uint32_t* dst, const uint32_t* src, int n) {
+                       BlitColorKeyPixels(dst, src, n, key);
+                   });
     return MAKE_ERROR(Error::kSuccess);
 }
 
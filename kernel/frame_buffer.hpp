@@ -12,14 +12,24 @@ class FrameBuffer {
     Error Initialize(const FrameBufferConfig& config);
     Error Copy(Vector2D<int> pos, const FrameBuffer& src,
                const Rectangle<int>& src_area);
+    // transparentと同じ色の画素は写さない
+    Error CopyTransparent(Vector2D<int> pos, const FrameBuffer& src,
+                          const Rectangle<int>& src_area,
+                          const PixelColor& transparent);
     void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
     FrameBufferDrawer& Drawer() { return *drawer_; }
+    const FrameBufferDrawer& Drawer() const { return *drawer_; }
     const FrameBufferConfig& Config() const { return config_; }
 
    private:
+    // 自前で確保するときは，各行が64バイト境界から始まるようにする
+    struct alignas(64) CacheLine {
+        uint8_t bytes[64];
+    };
+
     FrameBufferConfig config_{};
-    std::vector<uint8_t> buffer_{};
+    std::vector<CacheLine> buffer_{};
     std::unique_ptr<FrameBufferDrawer> drawer_{};
 };
 
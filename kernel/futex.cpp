@@ -0,0 +1,208 @@
+#include "futex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+
+#include "lock.hpp"
+#include "task.hpp"
+
+namespace {
+// 同じアドレスでもプロセスが違えば別のキーにする
+// 共有メモリ上のアドレスはprocessをnullptrにして物理アドレスで表す
+struct FutexKey {
+    const Process* process;
+    uint64_t addr;
+
+    bool operator==(const FutexKey& rhs) const {
+        return process == rhs.process && addr == rhs.addr;
+    }
+};
+
+struct FutexBucket;
+
+// 眠っているスレッドのカーネルスタック上に置く
+struct FutexWaiter {
+    FutexKey key;
+    Task* task;
+    FutexBucket* bucket;
+    bool woken;
+};
+
+struct FutexBucket {
+    SpinLock lock;
+    std::deque<FutexWaiter*> waiters;
+};
+
+const size_t kFutexBuckets = 64;
+std::array<FutexBucket, kFutexBuckets> futex_buckets;
+
+FutexKey MakeKey(Task& task, const uint32_t* addr) {
+    const auto vaddr = reinterpret_cast<uint64_t>(addr);
+    auto& process = task.GetProcess();
+
+    ScopedIRQLock lock{process.Lock()};
+    for (const auto& m : process.SharedMaps()) {
+        if (m.vaddr_begin <= vaddr && vaddr < m.vaddr_end) {
+            return {nullptr, m.shm->PhysAddr() + (vaddr - m.vaddr_begin)};
+        }
+    }
+    return {&process, vaddr};
+}
+
+FutexBucket& BucketOf(const FutexKey& key) {
+    uint64_t h = reinterpret_cast<uint64_t>(key.process) ^ (key.addr >> 2);
+    h *= 0x9e37'79b9'7f4a'7c15;
+    return futex_buckets[h >> 58];
+}
+static_assert(kFutexBuckets == 1 << (64 - 58));
+
+uint32_t ReadUser(const uint32_t* addr) {
+    return *reinterpret_cast<const volatile uint32_t*>(addr);
+}
+
+// 2つのバケットを常に同じ順番でロックする
+void LockBuckets(FutexBucket& a, FutexBucket& b) {
+    if (&a == &b) {
+        a.lock.Lock();
+    } else if (&a < &b) {
+        a.lock.Lock();
+        b.lock.Lock();
+    } else {
+        b.lock.Lock();
+        a.lock.Lock();
+    }
+}
+
+void UnlockBuckets(FutexBucket& a, FutexBucket& b) {
+    a.lock.Unlock();
+    if (&a != &b) {
+        b.lock.Unlock();
+    }
+}
+
+// bucketの中でkeyを待っているスレッドを最大count個起こす
+int WakeWaiters(FutexBucket& bucket, const FutexKey& key, int count) {
+    int woken = 0;
+    auto& waiters = bucket.waiters;
+    for (auto it = waiters.begin(); it != waiters.end() && woken < count;) {
+        FutexWaiter* waiter = *it;
+        if (!(waiter->key == key)) {
+            ++it;
+            continue;
+        }
+
+        it = waiters.erase(it);
+        waiter->woken = true;
+        task_manager->Wakeup(waiter->task);
+        ++woken;
+    }
+    return woken;
+}
+}  // namespace
+
+Error FutexWait(const uint32_t* addr, uint32_t expected) {
+    Task& task = task_manager->CurrentTask();
+    FutexWaiter waiter{MakeKey(task, addr), &task, nullptr, false};
+    waiter.bucket = &BucketOf(waiter.key);
+
+    // ページフォールトはロックを取る前に済ませておく
+    ReadUser(addr);
+
+    const auto rflags = SaveAndDisableInterrupts();
+    waiter.bucket->lock.Lock();
+    if (task.KillPending()) {
+        waiter.bucket->lock.Unlock();
+        RestoreInterrupts(rflags);
+        return MAKE_ERROR(Error::kInterrupted);
+    }
+    if (ReadUser(addr) != expected) {
+        waiter.bucket->lock.Unlock();
+        RestoreInterrupts(rflags);
+        return MAKE_ERROR(Error::kTryAgain);
+    }
+
+    waiter.bucket->waiters.push_back(&waiter);
+    waiter.bucket->lock.Unlock();
+    // 割り込み禁止のまま眠るので，FutexWakeからの起床を取りこぼさない
+    task.Sleep();
+
+    // REQUEUEで別のバケットへ移されていることがある
+    FutexBucket* bucket;
+    while (true) {
+        bucket = waiter.bucket;
+        bucket->lock.Lock();
+        if (bucket == waiter.bucket) {
+            break;
+        }
+        bucket->lock.Unlock();
+    }
+
+    const bool woken = waiter.woken;
+    if (!woken) {
+        auto& waiters = bucket->waiters;
+        waiters.erase(std::find(waiters.begin(), waiters.end(), &waiter));
+    }
+    bucket->lock.Unlock();
+    RestoreInterrupts(rflags);
+
+    if (!woken) {
+        return MAKE_ERROR(Error::kInterrupted);
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+int FutexWake(const uint32_t* addr, int count) {
+    const auto key = MakeKey(task_manager->CurrentTask(), addr);
+    auto& bucket = BucketOf(key);
+
+    ScopedIRQLock lock{bucket.lock};
+    return WakeWaiters(bucket, key, count);
+}
+
+WithError<int> FutexRequeue(const uint32_t* addr, int wake_count,
+                            const uint32_t* addr2, int requeue_count,
+                            std::optional<uint32_t> expected) {
+    Task& task = task_manager->CurrentTask();
+    const auto key = MakeKey(task, addr);
+    const auto key2 = MakeKey(task, addr2);
+    auto& bucket = BucketOf(key);
+    auto& bucket2 = BucketOf(key2);
+
+    if (expected) {
+        ReadUser(addr);
+    }
+
+    const auto rflags = SaveAndDisableInterrupts();
+    LockBuckets(bucket, bucket2);
+
+    if (expected && ReadUser(addr) != *expected) {
+        UnlockBuckets(bucket, bucket2);
+        RestoreInterrupts(rflags);
+        return {0, MAKE_ERROR(Error::kTryAgain)};
+    }
+
+    int done = WakeWaiters(bucket, key, wake_count);
+
+    // 残りは起こさずにaddr2の待ち行列へ移す
+    // requeue_countにはINT_MAXも渡されるので，あふれないよう64ビットで数える
+    const int64_t limit = static_cast<int64_t>(wake_count) + requeue_count;
+    auto& waiters = bucket.waiters;
+    for (auto it = waiters.begin(); it != waiters.end() && done < limit;) {
+        FutexWaiter* waiter = *it;
+        if (!(waiter->key == key)) {
+            ++it;
+            continue;
+        }
+
+        it = waiters.erase(it);
+        waiter->key = key2;
+        waiter->bucket = &bucket2;
+        bucket2.waiters.push_back(waiter);
+        ++done;
+    }
+
+    UnlockBuckets(bucket, bucket2);
+    RestoreInterrupts(rflags);
+    return {done, MAKE_ERROR(Error::kSuccess)};
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "error.hpp"
+
+// SyscallFutexの操作 apps/syscall.h の FUTEX_* と合わせる
+const int kFutexWait = 0;
+const int kFutexWake = 1;
+const int kFutexRequeue = 2;
+const int kFutexCmpRequeue = 3;
+
+// *addr == expected ならFutexWakeで起こされるまで眠る
+// 値が異なればkTryAgain，他の理由で起こされたらkInterruptedを返す
+Error FutexWait(const uint32_t* addr, uint32_t expected);
+// addrで眠っているスレッドを最大count個起こし，起こした数を返す
+int FutexWake(const uint32_t* addr, int count);
+// addrで眠っているスレッドをwake_count個起こし，残りのうち最大requeue_count個を
+// 起こさずにaddr2の待ち行列へ移す．起こした数と移した数の合計を返す
+// expectedを指定したときは *addr != expected ならkTryAgainを返して何もしない
+WithError<int> FutexRequeue(const uint32_t* addr, int wake_count,
+                            const uint32_t* addr2, int requeue_count,
+                            std::optional<uint32_t> expected);
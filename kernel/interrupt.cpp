@@ -28,12 +28,17 @@ void NotifyEndOfInterrupt() {
     *end_of_interrupt = 0;
 }
 
-namespace {
-__attribute__((interrupt)) void IntHandlerXHCI(InterruptFrame *frame) {
+// 起こしたメインタスクが実行中のタスクより高いレベルなら，タイムスライスを待たずに切り替える
+extern "C" void XHCIOnInterrupt(const TaskContext &ctx_stack) {
     task_manager->SendMessage(1, Message{Message::kInterruptXHCI});
     NotifyEndOfInterrupt();
+
+    if (task_manager->ReschedulePending()) {
+        task_manager->SwitchTask(ctx_stack, false);
+    }
 }
 
+namespace {
 void PrintHex(uint64_t value, int width, Vector2D<int> pos) {
     for (int i = 0; i < width; i++) {
         int x = (value >> 4 * (width - i - 1)) & 0xfu;
@@ -134,7 +139,11 @@ void InitializeInterrupt() {
                     reinterpret_cast<uint64_t>(handler), kKernelCS);
     };
 
-    set_idt_entry(InterruptVector::kXHCI, IntHandlerXHCI);
+    // どちらもタスクを切り替えることがあるので，割り込まれたタスクのスタックを使わない
+    SetIDTEntry(idt[InterruptVector::kXHCI],
+                MakeIDTAttr(DescriptorType::kInterruptGate, 0 /* DPL */,
+                            true /* present */, kISTForTimer /* IST */),
+                reinterpret_cast<uint64_t>(IntHandlerXHCI), kKernelCS);
     SetIDTEntry(idt[InterruptVector::kLAPICTimer],
                 MakeIDTAttr(DescriptorType::kInterruptGate, 0 /* DPL */,
                             true /* present */, kISTForTimer /* IST */),
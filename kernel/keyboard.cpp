@@ -3,6 +3,7 @@
 #include <memory>
 
 #include "task.hpp"
+#include "timer.hpp"
 #include "usb/classdriver/keyboard.hpp"
 
 namespace {
@@ -53,6 +54,7 @@ void InitializeKeyboard() {
         msg.arg.keyboard.keycode = keycode;
         msg.arg.keyboard.ascii = ascii;
         msg.arg.keyboard.press = press;
+        msg.arg.keyboard.timestamp = LAPICTimerCount();
         task_manager->SendMessage(1, msg);
     };
 }
\ No newline at end of file
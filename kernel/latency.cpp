@@ -0,0 +1,48 @@
+#include "latency.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include "lock.hpp"
+#include "timer.hpp"
+
+namespace {
+SpinLock latency_lock;
+// 画面へまだ反映されていない最も古いキー入力の時刻
+std::map<uint64_t, unsigned long> pending_keys;
+LatencyStat key_latency{};
+}  // namespace
+
+void RecordKeyPress(uint64_t task_id, unsigned long timestamp) {
+    ScopedIRQLock lock{latency_lock};
+    pending_keys.emplace(task_id, timestamp);
+}
+
+void RecordScreenUpdate(uint64_t task_id) {
+    const auto now = LAPICTimerCount();
+
+    ScopedIRQLock lock{latency_lock};
+    auto it = pending_keys.find(task_id);
+    if (it == pending_keys.end()) {
+        return;
+    }
+
+    const unsigned long us = (now - it->second) * 1000000 / lapic_timer_freq;
+    pending_keys.erase(it);
+
+    ++key_latency.count;
+    key_latency.last_us = us;
+    key_latency.max_us = std::max(key_latency.max_us, us);
+    key_latency.total_us += us;
+}
+
+LatencyStat KeyLatencyStat() {
+    ScopedIRQLock lock{latency_lock};
+    return key_latency;
+}
+
+void ResetKeyLatencyStat() {
+    ScopedIRQLock lock{latency_lock};
+    key_latency = LatencyStat{};
+    pending_keys.clear();
+}
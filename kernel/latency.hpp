@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// キー入力が画面へ反映されるまでの遅延の統計 (マイクロ秒)
+struct LatencyStat {
+    unsigned long count;
+    unsigned long last_us, max_us, total_us;
+};
+
+// task_id宛てのキー入力を記録する timestampはLAPICTimerCountの値
+void RecordKeyPress(uint64_t task_id, unsigned long timestamp);
+// task_idのタスクの描画が画面へ反映されたときに呼ぶ
+void RecordScreenUpdate(uint64_t task_id);
+LatencyStat KeyLatencyStat();
+void ResetKeyLatencyStat();
@@ -1,7 +1,10 @@
 #include "layer.hpp"
 
 #include <algorithm>
+#include <cstdlib>
+#include <limits>
 
+#include "compositor.hpp"
 #include "console.hpp"
 #include "logger.hpp"
 #include "message.hpp"
@@ -73,38 +76,319 @@ void LayerManager::RemoveLayer(unsigned int id) {
     EraseIf(layers_, pred);
 }
 
-void LayerManager::Draw(const Rectangle<int>& area) const {
-    for (auto layer : layer_stack_) {
-        layer->DrawTo(back_buffer_, area);
+namespace {
+// 重なるか接していればtrue
+bool Touches(const Rectangle<int>& a, const Rectangle<int>& b) {
+    return a.pos.x <= b.pos.x + b.size.x && b.pos.x <= a.pos.x + a.size.x &&
+           a.pos.y <= b.pos.y + b.size.y && b.pos.y <= a.pos.y + a.size.y;
+}
+
+Rectangle<int> BoundingBox(const Rectangle<int>& a, const Rectangle<int>& b) {
+    const auto pos = ElementMin(a.pos, b.pos);
+    const auto end = ElementMax(a.pos + a.size, b.pos + b.size);
+    return {pos, end - pos};
+}
+
+int Area(const Rectangle<int>& r) { return r.size.x * r.size.y; }
+
+// rectからholeを除いた残りを最大4つの長方形にしてoutへ追加する
+// holeはrectに含まれていること
+void SubtractRect(const Rectangle<int>& rect, const Rectangle<int>& hole,
+                  std::vector<Rectangle<int>>& out) {
+    const auto rect_end = rect.pos + rect.size;
+    const auto hole_end = hole.pos + hole.size;
+
+    if (hole.pos.y > rect.pos.y) {
+        out.push_back({rect.pos, {rect.size.x, hole.pos.y - rect.pos.y}});
+    }
+    if (hole_end.y < rect_end.y) {
+        out.push_back(
+            {{rect.pos.x, hole_end.y}, {rect.size.x, rect_end.y - hole_end.y}});
+    }
+    if (hole.pos.x > rect.pos.x) {
+        out.push_back(
+            {{rect.pos.x, hole.pos.y}, {hole.pos.x - rect.pos.x, hole.size.y}});
+    }
+    if (hole_end.x < rect_end.x) {
+        out.push_back(
+            {{hole_end.x, hole.pos.y}, {rect_end.x - hole_end.x, hole.size.y}});
+    }
+}
+}  // namespace
+
+void LayerManager::AddDamage(const Rectangle<int>& area) {
+    ASSERT_LOCK_HELD(layer_mutex);
+    auto rect = area & Rectangle<int>{{0, 0}, ScreenSize()};
+    if (rect.size.x <= 0 || rect.size.y <= 0) {
+        return;
     }
 
-    screen_->Copy(area.pos, back_buffer_, area);
+    while (true) {
+        // 重なる範囲は1つにまとめ，同じ画素を2度描かないようにする
+        // まとめた結果が別の範囲と重なることもあるので，最初から調べ直す
+        for (size_t i = 0; i < damage_.size();) {
+            if (Touches(damage_[i], rect)) {
+                rect = BoundingBox(damage_[i], rect);
+                damage_.erase(damage_.begin() + i);
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+
+        if (damage_.size() < kMaxDamageRects) {
+            break;
+        }
+
+        // 満杯なら，まとめても面積が最も増えない範囲とまとめる
+        // 広がった範囲が他の範囲と重なることがあるので，もう一度調べる
+        size_t best = 0;
+        int best_growth = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < damage_.size(); ++i) {
+            const int growth = Area(BoundingBox(damage_[i], rect)) -
+                               Area(damage_[i]) - Area(rect);
+            if (growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        rect = BoundingBox(damage_[best], rect);
+        damage_.erase(damage_.begin() + best);
+    }
+
+    damage_.push_back(rect);
 }
 
-void LayerManager::Draw(unsigned int id) const { Draw(id, {{0, 0}, {-1, -1}}); }
+void LayerManager::AddDamage(unsigned int id, Rectangle<int> area) {
+    auto layer = FindLayer(id);
+    if (layer == nullptr || !layer->GetWindow()) {
+        return;
+    }
+
+    Rectangle<int> window_area{layer->GetPosition(),
+                               layer->GetWindow()->Size()};
+    if (area.size.x >= 0 || area.size.y >= 0) {
+        area.pos = area.pos + window_area.pos;
+        window_area = window_area & area;
+    }
+    AddDamage(window_area);
+}
 
-void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
-    bool draw = false;
-    Rectangle<int> window_area;
-    for (auto layer : layer_stack_) {
-        if (layer->ID() == id) {
-            window_area.size = layer->GetWindow()->Size();
-            window_area.pos = layer->GetPosition();
+void LayerManager::Scroll(unsigned int id, const Rectangle<int>& area,
+                          int dy) {
+    ASSERT_LOCK_HELD(layer_mutex);
+    auto layer = FindLayer(id);
+    if (layer == nullptr || !layer->GetWindow()) {
+        return;
+    }
 
-            if (area.size.x >= 0 || area.size.y >= 0) {
-                area.pos = area.pos + window_area.pos;
-                window_area = window_area & area;
+    // 記録と同じロックの中でずらす．間に合成されると，画面では2度ずれてしまう
+    if (dy != 0 && std::abs(dy) < area.size.y) {
+        const Rectangle<int> kept{
+            area.pos + Vector2D<int>{0, std::max(-dy, 0)},
+            {area.size.x, area.size.y - std::abs(dy)}};
+        layer->GetWindow()->Move(kept.pos + Vector2D<int>{0, dy}, kept);
+    }
+
+    const Rectangle<int> screen_area{layer->GetPosition() + area.pos,
+                                     area.size};
+    const auto visible = screen_area & Rectangle<int>{{0, 0}, ScreenSize()};
+    // 合成済みの画素がそのレイヤのものだけのときに限り，ずらして使える
+    if (dy == 0 || std::abs(dy) >= area.size.y ||
+        !layer->GetWindow()->IsOpaque() || visible.pos.x != screen_area.pos.x ||
+        visible.pos.y != screen_area.pos.y ||
+        visible.size.x != screen_area.size.x ||
+        visible.size.y != screen_area.size.y || Occluded(layer, screen_area)) {
+        AddDamage(screen_area);
+        return;
+    }
+
+    // まだ画面に写していない範囲は，ずらした先でも描き直す
+    std::vector<Rectangle<int>> moved;
+    for (const auto& d : damage_) {
+        const auto overlap = d & screen_area;
+        if (overlap.size.x > 0 && overlap.size.y > 0) {
+            const Rectangle<int> shifted{overlap.pos + Vector2D<int>{0, dy},
+                                         overlap.size};
+            moved.push_back(shifted & screen_area);
+        }
+    }
+    for (const auto& d : moved) {
+        AddDamage(d);
+    }
+
+    // ずらしたことで新しく現れた部分
+    if (dy < 0) {
+        AddDamage({screen_area.pos + Vector2D<int>{0, screen_area.size.y + dy},
+                   {screen_area.size.x, -dy}});
+    } else {
+        AddDamage({screen_area.pos, {screen_area.size.x, dy}});
+    }
+
+    // 同じ範囲を続けてずらすなら，まとめて1回でずらす
+    if (!scrolls_.empty()) {
+        auto& last = scrolls_.back();
+        if (last.area.pos.x == screen_area.pos.x &&
+            last.area.pos.y == screen_area.pos.y &&
+            last.area.size.x == screen_area.size.x &&
+            last.area.size.y == screen_area.size.y) {
+            last.dy += dy;
+            if (last.dy == 0 || std::abs(last.dy) >= screen_area.size.y) {
+                scrolls_.pop_back();
+                AddDamage(screen_area);
             }
+            return;
+        }
+    }
+    scrolls_.push_back({screen_area, dy});
+}
+
+bool LayerManager::Occluded(const Layer* layer,
+                            const Rectangle<int>& area) const {
+    auto it = std::find(layer_stack_.begin(), layer_stack_.end(), layer);
+    if (it == layer_stack_.end()) {
+        return true;
+    }
+
+    for (++it; it != layer_stack_.end(); ++it) {
+        auto window = (*it)->GetWindow();
+        if (!window) {
+            continue;
+        }
+        const auto overlap =
+            area & Rectangle<int>{(*it)->GetPosition(), window->Size()};
+        if (overlap.size.x > 0 && overlap.size.y > 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            draw = true;
+void LayerManager::Flush() {
+    ASSERT_LOCK_HELD(layer_mutex);
+    if (cursor_drawn_pos_) {
+        // カーソルが動いたか，描き直す範囲やずらす範囲と重なるときだけ消す
+        const Rectangle<int> drawn{*cursor_drawn_pos_, cursor_->Size()};
+        bool hide = cursor_drawn_pos_->x != cursor_pos_.x ||
+                    cursor_drawn_pos_->y != cursor_pos_.y;
+        auto overlaps = [&drawn](const Rectangle<int>& area) {
+            const auto overlap = area & drawn;
+            return overlap.size.x > 0 && overlap.size.y > 0;
+        };
+        for (const auto& area : damage_) {
+            hide = hide || overlaps(area);
+        }
+        for (const auto& scroll : scrolls_) {
+            hide = hide || overlaps(scroll.area);
+        }
+        if (hide) {
+            HideCursor();
         }
+    }
 
-        if (draw) {
-            layer->DrawTo(back_buffer_, window_area);
+    // 画面の画素を読むと遅いので，back_buffer_の中でずらしてから写す
+    for (const auto& scroll : scrolls_) {
+        const auto& area = scroll.area;
+        const int dy = scroll.dy;
+        if (dy < 0) {
+            back_buffer_.Move(area.pos, {area.pos - Vector2D<int>{0, dy},
+                                         {area.size.x, area.size.y + dy}});
+        } else {
+            back_buffer_.Move(area.pos + Vector2D<int>{0, dy},
+                              {area.pos, {area.size.x, area.size.y - dy}});
         }
+        screen_->Copy(area.pos, back_buffer_, area);
+    }
+    scrolls_.clear();
+
+    for (const auto& area : damage_) {
+        Compose(area);
+    }
+    damage_.clear();
+
+    if (!cursor_drawn_pos_) {
+        ShowCursor();
+    }
+}
+
+void LayerManager::SetCursor(const std::shared_ptr<Window>& cursor) {
+    if (cursor_drawn_pos_) {
+        HideCursor();
     }
+    cursor_ = cursor;
+}
 
-    screen_->Copy(window_area.pos, back_buffer_, window_area);
+void LayerManager::MoveCursor(Vector2D<int> pos) { cursor_pos_ = pos; }
+
+void LayerManager::HideCursor() {
+    // カーソルの下の画素はback_buffer_に合成済みなので，そこから戻す
+    const Rectangle<int> drawn{*cursor_drawn_pos_, cursor_->Size()};
+    screen_->Copy(drawn.pos, back_buffer_, drawn);
+    cursor_drawn_pos_ = std::nullopt;
+}
+
+void LayerManager::ShowCursor() {
+    if (!cursor_) {
+        return;
+    }
+    cursor_->DrawTo(*screen_, cursor_pos_, {cursor_pos_, cursor_->Size()});
+    cursor_drawn_pos_ = cursor_pos_;
+}
+
+void LayerManager::Compose(const Rectangle<int>& area) {
+    // 最前面から順に，まだ覆われていない範囲のうち各レイヤが見える部分を集める
+    // 不透明なレイヤが覆った範囲はそれより下のレイヤでは描かない
+    uncovered_.clear();
+    uncovered_.push_back(area);
+    draw_list_.clear();
+
+    for (auto it = layer_stack_.rbegin();
+         it != layer_stack_.rend() && !uncovered_.empty(); ++it) {
+        Layer* layer = *it;
+        auto window = layer->GetWindow();
+        if (!window) {
+            continue;
+        }
+
+        const Rectangle<int> layer_area{layer->GetPosition(), window->Size()};
+        const bool opaque = window->IsOpaque();
+        next_uncovered_.clear();
+        for (const auto& u : uncovered_) {
+            const auto visible = u & layer_area;
+            if (visible.size.x <= 0 || visible.size.y <= 0) {
+                next_uncovered_.push_back(u);
+                continue;
+            }
+
+            draw_list_.push_back({layer, visible});
+            if (!opaque) {
+                // 透明な画素から下が見えるので，範囲はそのまま残す
+                next_uncovered_.push_back(u);
+                continue;
+            }
+            SubtractRect(u, visible, next_uncovered_);
+        }
+        std::swap(uncovered_, next_uncovered_);
+    }
+
+    // 透明なレイヤを下のレイヤの上に重ねられるよう，最背面側から描く
+    for (auto it = draw_list_.rbegin(); it != draw_list_.rend(); ++it) {
+        it->layer->DrawTo(back_buffer_, it->area);
+    }
+
+    screen_->Copy(area.pos, back_buffer_, area);
+}
+
+void LayerManager::Draw(const Rectangle<int>& area) {
+    AddDamage(area);
+    RequestCompose();
+}
+
+void LayerManager::Draw(unsigned int id) { Draw(id, {{0, 0}, {-1, -1}}); }
+
+void LayerManager::Draw(unsigned int id, Rectangle<int> area) {
+    AddDamage(id, area);
+    RequestCompose();
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_position) {
@@ -112,8 +396,8 @@ void LayerManager::Move(unsigned int id, Vector2D<int> new_position) {
     const auto window_size = layer->GetWindow()->Size();
     const auto old_pos = layer->GetPosition();
     layer->Move(new_position);
-    Draw({old_pos, window_size});
-    Draw(id);
+    AddDamage({old_pos, window_size});
+    AddDamage({new_position, window_size});
 }
 
 void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
@@ -121,8 +405,8 @@ void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
     const auto window_size = layer->GetWindow()->Size();
     const auto old_pos = layer->GetPosition();
     layer->MoveRelative(pos_diff);
-    Draw({old_pos, window_size});
-    Draw(id);
+    AddDamage({old_pos, window_size});
+    AddDamage({layer->GetPosition(), window_size});
 }
 
 void LayerManager::UpDown(unsigned int id, int new_height) {
@@ -227,10 +511,6 @@ Error SendWindowActiveMessage(unsigned int layer_id, int active) {
 
 ActiveLayer::ActiveLayer(LayerManager& manager) : manager_{manager} {}
 
-void ActiveLayer::SetMouseLayer(unsigned int mouse_layer) {
-    mouse_layer_ = mouse_layer;
-}
-
 void ActiveLayer::Activate(unsigned int layer_id) {
     if (active_layer_ == layer_id) {
         return;
@@ -239,7 +519,7 @@ void ActiveLayer::Activate(unsigned int layer_id) {
     if (active_layer_ > 0) {
         Layer* layer = manager_.FindLayer(active_layer_);
         layer->GetWindow()->Deactivate();
-        manager_.Draw(active_layer_);
+        manager_.AddDamage(active_layer_);
         SendWindowActiveMessage(active_layer_, 0);
     }
 
@@ -248,14 +528,16 @@ void ActiveLayer::Activate(unsigned int layer_id) {
         Layer* layer = manager_.FindLayer(active_layer_);
         layer->GetWindow()->Activate();
         manager_.UpDown(active_layer_, 0);
-        manager_.UpDown(active_layer_, manager_.GetHeight(mouse_layer_) - 1);
-        manager_.Draw(active_layer_);
+        manager_.UpDown(active_layer_, std::numeric_limits<int>::max());
+        manager_.AddDamage(active_layer_);
         SendWindowActiveMessage(active_layer_, 1);
     }
+    RequestCompose();
 }
 
 ActiveLayer* active_layer;
 std::map<unsigned int, uint64_t>* layer_task_map;
+Mutex layer_mutex;
 
 void InitializeLayer() {
     const auto screen_size = ScreenSize();
@@ -291,6 +573,7 @@ void InitializeLayer() {
 }
 
 void ProcessLayerMessage(const Message& msg) {
+    ScopedLock lock{layer_mutex};
     const auto& arg = msg.arg.layer;
     switch (arg.op) {
         case LayerOperation::Move:
@@ -300,15 +583,18 @@ void ProcessLayerMessage(const Message& msg) {
             layer_manager->MoveRelative(arg.layer_id, {arg.x, arg.y});
             break;
         case LayerOperation::Draw:
-            layer_manager->Draw(arg.layer_id);
+            layer_manager->AddDamage(arg.layer_id);
             break;
         case LayerOperation::DrawArea:
-            layer_manager->Draw(arg.layer_id, {{arg.x, arg.y}, {arg.w, arg.h}});
+            layer_manager->AddDamage(arg.layer_id,
+                                     {{arg.x, arg.y}, {arg.w, arg.h}});
             break;
     }
+    RequestCompose(msg.source_task);
 }
 
 Error CloseLayer(unsigned int layer_id) {
+    ScopedLock lock{layer_mutex};
     Layer* layer = layer_manager->FindLayer(layer_id);
     if (layer == nullptr) {
         return MAKE_ERROR(Error::kNoSuchEntry);
@@ -317,12 +603,10 @@ Error CloseLayer(unsigned int layer_id) {
     const auto pos = layer->GetPosition();
     const auto size = layer->GetWindow()->Size();
 
-    __asm__("cli");
     active_layer->Activate(0);
     layer_manager->RemoveLayer(layer_id);
     layer_manager->Draw({pos, size});
     layer_task_map->erase(layer_id);
-    __asm__("sti");
 
     return MAKE_ERROR(Error::kSuccess);
 }
\ No newline at end of file
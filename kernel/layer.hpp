@@ -2,9 +2,11 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "drawing.hpp"
+#include "lock.hpp"
 #include "message.hpp"
 #include "window.hpp"
 
@@ -36,12 +38,30 @@ class LayerManager {
     Layer& NewLayer();
     void RemoveLayer(unsigned int id);
 
-    void Draw(const Rectangle<int>& area) const;
-    void Draw(unsigned int id) const;
-    void Draw(unsigned int id, const Rectangle<int> area) const;
+    // 再描画が必要な範囲を記録するだけで，画面へはFlushでまとめて写す
+    void AddDamage(const Rectangle<int>& area);
+    // areaはレイヤの左上からの範囲．大きさが負ならレイヤ全体
+    void AddDamage(unsigned int id, Rectangle<int> area = {{0, 0}, {-1, -1}});
+    // 記録した範囲を重なりなく描き直して画面へ写す．合成タスクから呼ぶ
+    void Flush();
 
+    // 範囲を記録して合成タスクに描かせる
+    void Draw(const Rectangle<int>& area);
+    void Draw(unsigned int id);
+    void Draw(unsigned int id, const Rectangle<int> area);
+
+    // 移動前と移動後の範囲を記録する．描かせるには呼び出し側がRequestComposeする
     void Move(unsigned int id, Vector2D<int> new_position);
     void MoveRelative(unsigned int id, Vector2D<int> pos_diff);
+    // ウィンドウの画素をareaの中でdyだけずらし，合成済みの画素も次のFlushでずらす
+    // 描き直すのは新しく現れた部分だけになる．その部分の画素は呼び出し側が描く
+    // 他のレイヤに隠れているなどでずらせなければ，area全体を記録する
+    void Scroll(unsigned int id, const Rectangle<int>& area, int dy);
+
+    // マウスカーソルはレイヤと合成せず，Flushの最後に画面へ直接重ねる
+    void SetCursor(const std::shared_ptr<Window>& cursor);
+    // 位置を記録するだけで，描くのは次のFlush
+    void MoveCursor(Vector2D<int> pos);
 
     void UpDown(unsigned int id, int new_height);
     void Hide(unsigned int id);
@@ -50,14 +70,45 @@ class LayerManager {
     Layer* FindLayer(unsigned int id);
     int GetHeight(unsigned int id);
 
+    // 記録しておく範囲の数の上限．超えたら近いものどうしをまとめる
+    static const size_t kMaxDamageRects = 8;
+
    private:
     FrameBuffer* screen_{nullptr};
     mutable FrameBuffer back_buffer_{};
+    // 互いに重ならない再描画待ちの範囲
+    std::vector<Rectangle<int>> damage_{};
+    // 再描画の前に，画面上でずらしておく範囲．記録した順に処理する
+    struct ScrollArea {
+        Rectangle<int> area;
+        int dy;
+    };
+    std::vector<ScrollArea> scrolls_{};
     // 全てのレイヤを格納する動的配列
     std::vector<std::unique_ptr<Layer>> layers_{};
     // レイヤの重なりを表す配列 先頭が最背面となり、末尾が最前面となる
     std::vector<Layer*> layer_stack_{};
     unsigned int latest_id_{0};
+
+    std::shared_ptr<Window> cursor_{};
+    Vector2D<int> cursor_pos_{};
+    // 画面にカーソルを描いてある位置
+    // back_buffer_はカーソルを含まないので，カーソルの下の画素の退避先を兼ねる
+    std::optional<Vector2D<int>> cursor_drawn_pos_{};
+
+    // Composeで使う作業領域．毎回確保し直さないように持っておく
+    struct LayerArea {
+        Layer* layer;
+        Rectangle<int> area;
+    };
+    std::vector<Rectangle<int>> uncovered_{};
+    std::vector<Rectangle<int>> next_uncovered_{};
+    std::vector<LayerArea> draw_list_{};
+
+    void Compose(const Rectangle<int>& area);
+    bool Occluded(const Layer* layer, const Rectangle<int>& area) const;
+    void HideCursor();
+    void ShowCursor();
 };
 
 extern LayerManager* layer_manager;
@@ -65,18 +116,18 @@ extern LayerManager* layer_manager;
 class ActiveLayer {
    public:
     ActiveLayer(LayerManager& manager);
-    void SetMouseLayer(unsigned int mouse_layer);
     void Activate(unsigned int layer_id);
     unsigned int GetActiveLayer() const { return active_layer_; }
 
    private:
     LayerManager& manager_;
     unsigned int active_layer_{0};
-    unsigned int mouse_layer_{0};
 };
 
 extern ActiveLayer* active_layer;
 extern std::map<unsigned int, uint64_t>* layer_task_map;
+// layer_manager，active_layer，layer_task_map を操作する間は保持する
+extern Mutex layer_mutex;
 
 void InitializeLayer();
 
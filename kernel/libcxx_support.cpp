@@ -1,10 +1,17 @@
 #include <new>
 #include <cerrno>
+#include <malloc.h>
 
 std::new_handler std::get_new_handler() noexcept {
   return nullptr;
 }
 
-extern "C" int posix_memalign(void**, size_t, size_t) {
-  return ENOMEM;
+// alignasで64バイト境界を要求するTaskContextをnewするために使われる
+extern "C" int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  void* p = memalign(alignment, size);
+  if (p == nullptr) {
+    return ENOMEM;
+  }
+  *memptr = p;
+  return 0;
 }
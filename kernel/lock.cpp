@@ -0,0 +1,205 @@
+#include "lock.hpp"
+
+#include <algorithm>
+
+#include "logger.hpp"
+#include "task.hpp"
+
+namespace {
+Task* CurrentTaskOrNull() {
+    if (task_manager == nullptr) {
+        return nullptr;
+    }
+    return &task_manager->CurrentTask();
+}
+
+// 待ち行列に入った直後に眠る
+// 割り込みは禁止されたままなので，Unlockからの起床を取りこぼさない
+void SleepAfterUnlock(SpinLock& lock, Task* task) {
+    if (task == nullptr) {
+        LockAssertionFailed("contended before task initialization", __FILE__,
+                            __LINE__);
+    }
+    lock.Unlock();
+    task_manager->Sleep(task);
+}
+}  // namespace
+
+void LockAssertionFailed(const char* what, const char* file, int line) {
+    __asm__("cli");
+    Log(kError, "lock assertion failed: %s at %s:%d\n", what, file, line);
+    while (1) {
+        __asm__("hlt");
+    }
+}
+
+void SpinLock::Lock() {
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+        while (locked_.load(std::memory_order_relaxed)) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+bool SpinLock::TryLock() {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+}
+
+void SpinLock::Unlock() { locked_.store(false, std::memory_order_release); }
+
+uint64_t SpinLock::LockIRQSave() {
+    const auto rflags = SaveAndDisableInterrupts();
+    Lock();
+    return rflags;
+}
+
+void SpinLock::UnlockIRQRestore(uint64_t rflags) {
+    Unlock();
+    RestoreInterrupts(rflags);
+}
+
+void SpinLock::AssertHeld(const char* file, int line) const {
+    if (!IsLocked()) {
+        LockAssertionFailed("spinlock not held", file, line);
+    }
+}
+
+void Mutex::Lock() {
+    Task* current = CurrentTaskOrNull();
+    const auto rflags = lock_.LockIRQSave();
+    if (!locked_) {
+        locked_ = true;
+        owner_ = current;
+        lock_.UnlockIRQRestore(rflags);
+        return;
+    }
+
+    if (owner_ == current) {
+        LockAssertionFailed("recursive mutex lock", __FILE__, __LINE__);
+    }
+
+    // Unlockが所有権をこのタスクへ直接渡してから起こす
+    // メッセージなどで渡される前に起こされることもあるので，渡されるまで眠り直す
+    waiters_.push_back(current);
+    do {
+        SleepAfterUnlock(lock_, current);
+        lock_.Lock();
+    } while (owner_ != current);
+    lock_.UnlockIRQRestore(rflags);
+}
+
+bool Mutex::TryLock() {
+    Task* current = CurrentTaskOrNull();
+    ScopedIRQLock lock{lock_};
+    if (locked_) {
+        return false;
+    }
+    locked_ = true;
+    owner_ = current;
+    return true;
+}
+
+void Mutex::Unlock() {
+    ScopedIRQLock lock{lock_};
+    if (waiters_.empty()) {
+        locked_ = false;
+        owner_ = nullptr;
+        return;
+    }
+
+    owner_ = waiters_.front();
+    waiters_.pop_front();
+    task_manager->Wakeup(owner_);
+}
+
+bool Mutex::IsHeldByCurrentTask() const {
+    return locked_ && owner_ == CurrentTaskOrNull();
+}
+
+void Mutex::AssertHeld(const char* file, int line) const {
+    if (!IsHeldByCurrentTask()) {
+        LockAssertionFailed("mutex not held by current task", file, line);
+    }
+}
+
+void RWLock::ReadLock() {
+    Task* current = CurrentTaskOrNull();
+    const auto rflags = lock_.LockIRQSave();
+    if (!writing_ && write_waiters_.empty()) {
+        ++readers_;
+        lock_.UnlockIRQRestore(rflags);
+        return;
+    }
+
+    // WriteUnlockがreaders_を加算し，待ち行列から外してから起こす
+    read_waiters_.push_back(current);
+    do {
+        SleepAfterUnlock(lock_, current);
+        lock_.Lock();
+    } while (std::find(read_waiters_.begin(), read_waiters_.end(), current) !=
+             read_waiters_.end());
+    lock_.UnlockIRQRestore(rflags);
+}
+
+void RWLock::ReadUnlock() {
+    ScopedIRQLock lock{lock_};
+    if (--readers_ > 0 || write_waiters_.empty()) {
+        return;
+    }
+
+    writing_ = true;
+    writer_ = write_waiters_.front();
+    write_waiters_.pop_front();
+    task_manager->Wakeup(writer_);
+}
+
+void RWLock::WriteLock() {
+    Task* current = CurrentTaskOrNull();
+    const auto rflags = lock_.LockIRQSave();
+    if (!writing_ && readers_ == 0) {
+        writing_ = true;
+        writer_ = current;
+        lock_.UnlockIRQRestore(rflags);
+        return;
+    }
+
+    // 書き込み側はwriter_をこのタスクにしてから起こされる
+    write_waiters_.push_back(current);
+    do {
+        SleepAfterUnlock(lock_, current);
+        lock_.Lock();
+    } while (writer_ != current);
+    lock_.UnlockIRQRestore(rflags);
+}
+
+void RWLock::WriteUnlock() {
+    ScopedIRQLock lock{lock_};
+    if (!write_waiters_.empty()) {
+        writer_ = write_waiters_.front();
+        write_waiters_.pop_front();
+        task_manager->Wakeup(writer_);
+        return;
+    }
+
+    writing_ = false;
+    writer_ = nullptr;
+    while (!read_waiters_.empty()) {
+        ++readers_;
+        task_manager->Wakeup(read_waiters_.front());
+        read_waiters_.pop_front();
+    }
+}
+
+void RWLock::AssertReadHeld(const char* file, int line) const {
+    if (readers_ == 0 && !writing_) {
+        LockAssertionFailed("rwlock not held", file, line);
+    }
+}
+
+void RWLock::AssertWriteHeld(const char* file, int line) const {
+    if (!writing_ || writer_ != CurrentTaskOrNull()) {
+        LockAssertionFailed("rwlock not write-held by current task", file,
+                            line);
+    }
+}
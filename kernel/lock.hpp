@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+class Task;
+
+// RFLAGSのIFビット
+const uint64_t kRFlagsIF = 1u << 9;
+
+// 現在のRFLAGSを返して割り込みを禁止する
+inline uint64_t SaveAndDisableInterrupts() {
+    uint64_t rflags;
+    __asm__ volatile("pushfq\n\tpopq %0\n\tcli" : "=r"(rflags) : : "memory");
+    return rflags;
+}
+
+// SaveAndDisableInterruptsで保存した割り込み状態に戻す
+inline void RestoreInterrupts(uint64_t rflags) {
+    if (rflags & kRFlagsIF) {
+        __asm__ volatile("sti" : : : "memory");
+    }
+}
+
+[[noreturn]] void LockAssertionFailed(const char* what, const char* file,
+                                      int line);
+
+// 割り込みハンドラと共有するデータを短時間だけ保護するためのロック
+// 保持中に眠ってはいけない
+class SpinLock {
+   public:
+    void Lock();
+    bool TryLock();
+    void Unlock();
+
+    // 割り込みを禁止してからロックを取得し，元のRFLAGSを返す
+    uint64_t LockIRQSave();
+    void UnlockIRQRestore(uint64_t rflags);
+
+    bool IsLocked() const { return locked_.load(std::memory_order_relaxed); }
+    void AssertHeld(const char* file, int line) const;
+
+   private:
+    std::atomic<bool> locked_{false};
+};
+
+// 保持中に眠ることができるロック．割り込みハンドラからは使えない
+// タスク管理の初期化前でも使えるが，その間は競合しないことが前提
+class Mutex {
+   public:
+    void Lock();
+    bool TryLock();
+    void Unlock();
+
+    bool IsHeldByCurrentTask() const;
+    void AssertHeld(const char* file, int line) const;
+
+   private:
+    SpinLock lock_;
+    bool locked_{false};
+    Task* owner_{nullptr};
+    std::deque<Task*> waiters_{};
+};
+
+// 読み込み側を並行に許すMutex．書き込み待ちがいれば新しい読み込みを待たせる
+class RWLock {
+   public:
+    void ReadLock();
+    void ReadUnlock();
+    void WriteLock();
+    void WriteUnlock();
+
+    void AssertReadHeld(const char* file, int line) const;
+    void AssertWriteHeld(const char* file, int line) const;
+
+   private:
+    SpinLock lock_;
+    int readers_{0};
+    bool writing_{false};
+    Task* writer_{nullptr};
+    std::deque<Task*> read_waiters_{}, write_waiters_{};
+};
+
+template <class LockType>
+class ScopedLock {
+   public:
+    explicit ScopedLock(LockType& lock) : lock_{lock} { lock_.Lock(); }
+    ~ScopedLock() { lock_.Unlock(); }
+    ScopedLock(const ScopedLock&) = delete;
+    ScopedLock& operator=(const ScopedLock&) = delete;
+
+   private:
+    LockType& lock_;
+};
+
+class ScopedIRQLock {
+   public:
+    explicit ScopedIRQLock(SpinLock& lock)
+        : lock_{lock}, rflags_{lock.LockIRQSave()} {}
+    ~ScopedIRQLock() { lock_.UnlockIRQRestore(rflags_); }
+    ScopedIRQLock(const ScopedIRQLock&) = delete;
+    ScopedIRQLock& operator=(const ScopedIRQLock&) = delete;
+
+   private:
+    SpinLock& lock_;
+    uint64_t rflags_;
+};
+
+// メッセージの確認からSleepまでの間だけ割り込みを禁止する
+class InterruptGuard {
+   public:
+    InterruptGuard() : rflags_{SaveAndDisableInterrupts()} {}
+    ~InterruptGuard() { RestoreInterrupts(rflags_); }
+    InterruptGuard(const InterruptGuard&) = delete;
+    InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+   private:
+    uint64_t rflags_;
+};
+
+#define ASSERT_LOCK_HELD(lock) (lock).AssertHeld(__FILE__, __LINE__)
@@ -8,13 +8,16 @@
 
 #include "acpi.hpp"
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "console.hpp"
 #include "drawing.hpp"
 #include "fat.hpp"
 #include "font.hpp"
+#include "fpu.hpp"
 #include "frame_buffer_config.hpp"
 #include "interrupt.hpp"
 #include "keyboard.hpp"
+#include "latency.hpp"
 #include "layer.hpp"
 #include "logger.hpp"
 #include "memory_manager.hpp"
@@ -23,6 +26,7 @@
 #include "mouse.hpp"
 #include "paging.hpp"
 #include "pci.hpp"
+#include "pixel_kernel.hpp"
 #include "segment.hpp"
 #include "syscall.hpp"
 #include "task.hpp"
@@ -60,6 +64,9 @@ extern "C" void KernelMainNewStack(
 
     InitializeTSS();
 
+    InitializeFPU();
+    InitializePixelKernels();
+
     InitializeInterrupt();
 
     fat::Initialize(volume_image);
@@ -70,7 +77,9 @@ extern "C" void KernelMainNewStack(
 
     InitializeLayer();
 
+    layer_mutex.Lock();
     layer_manager->Draw({{0, 0}, ScreenSize()});
+    layer_mutex.Unlock();
 
     acpi::Initialize(acpi_table);
     InitializeLAPICTimer();
@@ -83,6 +92,7 @@ extern "C" void KernelMainNewStack(
 
     InitializeTask();
     Task &main_task = task_manager->CurrentTask();
+    InitializeCompositor();
 
     usb::xhci::Initialize();
     InitializeKeyboard();
@@ -91,16 +101,11 @@ extern "C" void KernelMainNewStack(
     task_manager->NewTask().InitContext(TaskTerminal, 0).Wakeup().ID();
 
     while (true) {
-        __asm__("cli");
-        auto msg = main_task.ReceiveMessage();
+        auto msg = main_task.WaitMessage();
         if (!msg) {
-            main_task.Sleep();
-            __asm__("sti");
             continue;
         }
 
-        __asm__("sti");
-
         switch (msg->type) {
             case Message::kInterruptXHCI:
                 usb::xhci::ProcessEvents();
@@ -115,14 +120,21 @@ extern "C" void KernelMainNewStack(
                         .InitContext(TaskTerminal, 0)
                         .Wakeup();
                 } else {
-                    __asm__("cli");
-                    auto task_it = layer_task_map->find(act);
-                    __asm__("sti");
-
-                    if (task_it != layer_task_map->end()) {
-                        __asm__("cli");
-                        task_manager->SendMessage(task_it->second, *msg);
-                        __asm__("sti");
+                    uint64_t task_id = 0;
+                    {
+                        ScopedLock lock{layer_mutex};
+                        auto task_it = layer_task_map->find(act);
+                        if (task_it != layer_task_map->end()) {
+                            task_id = task_it->second;
+                        }
+                    }
+
+                    if (task_id != 0) {
+                        if (msg->arg.keyboard.press) {
+                            RecordKeyPress(task_id,
+                                           msg->arg.keyboard.timestamp);
+                        }
+                        task_manager->SendMessage(task_id, *msg);
                     } else {
                         printk(
                             "key push not handled: keycode %02x, ascii %02x\n",
@@ -133,10 +145,8 @@ extern "C" void KernelMainNewStack(
 
             case Message::kLayer:
                 ProcessLayerMessage(*msg);
-                __asm__("cli");
                 task_manager->SendMessage(msg->source_task,
                                           Message{Message::kLayerFinish});
-                __asm__("sti");
                 break;
             default:
                 printk("Unknown message type: %d\n", msg->type);
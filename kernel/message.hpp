@@ -12,8 +12,8 @@ struct Message {
         kMouseMove,
         kMouseButton,
         kWindowActive,
-        kPipe,
         KWindowClose,
+        kCompose,
     } type;
 
     uint64_t source_task;
@@ -29,6 +29,8 @@ struct Message {
             uint8_t keycode;
             char ascii;
             int press;
+            // 入力遅延の計測用 LAPICTimerCountの値
+            unsigned long timestamp;
         } keyboard;
 
         struct {
@@ -54,11 +56,6 @@ struct Message {
             int activate;
         } window_active;
 
-        struct {
-            char data[16];
-            uint8_t len;
-        } pipe;
-
         struct {
             unsigned int layer_id;
         } window_close;
@@ -0,0 +1,77 @@
+#include "message_queue.hpp"
+
+MessageQueue::MessageQueue() {
+    for (size_t i = 0; i < kCapacity; ++i) {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool MessageQueue::Push(const Message& msg) {
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & (kCapacity - 1)];
+        const uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            // 書き込む場所を予約する．失敗したらposが更新されるのでやり直す
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                                   std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->msg = msg;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool MessageQueue::CoalesceMouseMove(const Message& msg) {
+    const uint64_t pos = enqueue_pos_.load(std::memory_order_acquire);
+    if (pos == 0) {
+        return false;
+    }
+
+    Cell& cell = cells_[(pos - 1) & (kCapacity - 1)];
+    uint64_t seq = pos;
+    if (!cell.seq.compare_exchange_strong(seq, pos | kCellBusy,
+                                          std::memory_order_acquire)) {
+        // 既に読まれたか，まだ書き込み中
+        return false;
+    }
+
+    // 後ろに別のメッセージが入っていたら順番が変わるのでまとめない
+    const bool coalesce = cell.msg.type == Message::kMouseMove &&
+                          enqueue_pos_.load(std::memory_order_relaxed) == pos;
+    if (coalesce) {
+        auto& move = cell.msg.arg.mouse_move;
+        move.x = msg.arg.mouse_move.x;
+        move.y = msg.arg.mouse_move.y;
+        move.dx += msg.arg.mouse_move.dx;
+        move.dy += msg.arg.mouse_move.dy;
+        move.buttons = msg.arg.mouse_move.buttons;
+    }
+
+    cell.seq.store(pos, std::memory_order_release);
+    return coalesce;
+}
+
+std::optional<Message> MessageQueue::Pop() {
+    Cell& cell = cells_[dequeue_pos_ & (kCapacity - 1)];
+    // 予約されただけでまだ書き込まれていなければ空とみなす
+    // 書き込みを終えた送信側が受信側を起こす
+    if (cell.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+        return std::nullopt;
+    }
+
+    Message msg = cell.msg;
+    cell.seq.store(dequeue_pos_ + kCapacity, std::memory_order_release);
+    ++dequeue_pos_;
+    return msg;
+}
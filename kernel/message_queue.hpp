@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "message.hpp"
+
+// 容量固定のロックフリーなメッセージキュー
+// 送信側は複数（割り込みハンドラや他のタスク），受信側はキューを持つタスクだけ
+// 送信側はメモリを確保せず，満杯なら捨てて数を数える
+class MessageQueue {
+   public:
+    static const size_t kCapacity = 256;
+
+    MessageQueue();
+    MessageQueue(const MessageQueue&) = delete;
+    MessageQueue& operator=(const MessageQueue&) = delete;
+
+    // 満杯ならfalseを返す
+    bool Push(const Message& msg);
+    // 末尾にまだ読まれていないマウス移動があれば，位置を置き換えて移動量を足し込む
+    // まとめられなければfalseを返すので，そのときはPushする
+    bool CoalesceMouseMove(const Message& msg);
+    // 受信側のタスクだけが呼ぶ
+    std::optional<Message> Pop();
+    // 満杯で捨てたメッセージの数
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+   private:
+    static_assert((kCapacity & (kCapacity - 1)) == 0);
+
+    // seqが書き込み位置+1なら読める，読み込み位置+kCapacityなら書ける
+    // CoalesceMouseMoveが書き換えている間は最上位ビットを立てて読めなくする
+    static const uint64_t kCellBusy = 1ul << 63;
+    struct Cell {
+        std::atomic<uint64_t> seq;
+        Message msg;
+    };
+
+    std::array<Cell, kCapacity> cells_;
+    // 送信側と受信側が同じキャッシュラインを奪い合わないように離しておく
+    alignas(64) std::atomic<uint64_t> enqueue_pos_{0};
+    alignas(64) uint64_t dequeue_pos_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
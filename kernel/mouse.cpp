@@ -1,14 +1,16 @@
 #include "mouse.hpp"
 
-#include <limits>
 #include <memory>
 
+#include "compositor.hpp"
 #include "drawing.hpp"
 #include "layer.hpp"
 #include "task.hpp"
 #include "usb/classdriver/mouse.hpp"
 
 namespace {
+std::shared_ptr<Mouse> mouse;
+
 const char mouse_cursor_shape[kMouseCursorHeight][kMouseCursorWidth + 1] = {
     "@              ", "@@             ", "@.@            ", "@..@           ",
     "@...@          ", "@....@         ", "@.....@        ", "@......@       ",
@@ -105,21 +107,20 @@ void DrawMouseCursor(ScreenDrawer *drawer, Vector2D<int> pos) {
     }
 }
 
-Mouse::Mouse(unsigned int layer_id) : layer_id_{layer_id} {}
-
 void Mouse::SetPosition(Vector2D<int> position) {
     position_ = position;
-    layer_manager->Move(layer_id_, position);
+    layer_manager->MoveCursor(position_);
+    RequestCompose();
 }
 
 void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
                         int8_t displacement_y) {
+    ScopedLock lock{layer_mutex};
     const auto old_pos = position_;
     auto new_pos = position_ + Vector2D<int>{displacement_x, displacement_y};
     new_pos = ElementMin(new_pos, ScreenSize() + Vector2D<int>{-1, -1});
     position_ = ElementMax(new_pos, {0, 0});
 
-    layer_manager->Move(layer_id_, position_);
     const auto pos_diff = position_ - old_pos;
 
     unsigned int close_layer_id = 0;
@@ -128,7 +129,7 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
     const bool left_pressed = (buttons & 0x01);
 
     if (!previous_left_pressed && left_pressed) {
-        auto layer = layer_manager->FindLayerByPoisition(position_, layer_id_);
+        auto layer = layer_manager->FindLayerByPoisition(position_, 0);
         if (layer && layer->IsDraggable()) {
             const auto pos_layer = position_ - layer->GetPosition();
             switch (layer->GetWindow()->GetWindowRegion(pos_layer)) {
@@ -147,7 +148,7 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
             active_layer->Activate(0);
         }
     } else if (previous_left_pressed && left_pressed) {
-        if (drag_layer_id_ > 0) {
+        if (drag_layer_id_ > 0 && (pos_diff.x != 0 || pos_diff.y != 0)) {
             layer_manager->MoveRelative(drag_layer_id_, pos_diff);
         }
     } else if (previous_left_pressed && !left_pressed) {
@@ -163,25 +164,26 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
     }
 
     previous_buttons_ = buttons;
+    // カーソルは合成タスクが画面へ直接重ねるので，他のレイヤは描き直さない
+    // 1フレームの間に届いた移動はまとめて描かれる
+    layer_manager->MoveCursor(position_);
+    RequestCompose();
 }
 
 void InitializeMouse() {
-    auto mouse_window = std::make_shared<Window>(
+    auto cursor = std::make_shared<Window>(
         kMouseCursorWidth, kMouseCursorHeight, screen_config.pixel_format);
-    mouse_window->SetTransparentColor(kMouseTransparentColor);
-    DrawMouseCursor(mouse_window->Drawer(), {0, 0});
+    cursor->SetTransparentColor(kMouseTransparentColor);
+    DrawMouseCursor(cursor->Drawer(), {0, 0});
 
-    auto mouse_layer_id =
-        layer_manager->NewLayer().SetWindow(mouse_window).ID();
+    ScopedLock lock{layer_mutex};
+    layer_manager->SetCursor(cursor);
 
-    auto mouse = std::make_shared<Mouse>(mouse_layer_id);
+    mouse = std::make_shared<Mouse>();
     mouse->SetPosition({200, 200});
-    layer_manager->UpDown(mouse->LayerID(), std::numeric_limits<int>::max());
 
     usb::HIDMouseDriver::default_observer =
-        [mouse](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
+        [](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
             mouse->OnInterrupt(buttons, displacement_x, displacement_y);
         };
-
-    active_layer->SetMouseLayer(mouse_layer_id);
-}
\ No newline at end of file
+}
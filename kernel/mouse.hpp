@@ -10,19 +10,16 @@ void DrawMouseCursor(ScreenDrawer* screen_drawer, Vector2D<int> position);
 
 class Mouse {
    public:
-    Mouse(unsigned int layer_id);
     void OnInterrupt(uint8_t buttons, int8_t displacement_x,
                      int8_t displacement_y);
     void SetPosition(Vector2D<int> position);
 
-    unsigned int LayerID() const { return layer_id_; }
     Vector2D<int> Position() const { return position_; }
 
    private:
-    unsigned int layer_id_;
     Vector2D<int> position_{};
     unsigned int drag_layer_id_{0};
     uint8_t previous_buttons_{0};
 };
 
-void InitializeMouse();
\ No newline at end of file
+void InitializeMouse();
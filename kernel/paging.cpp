@@ -94,6 +94,33 @@ WithError<size_t> SetupPageMap(PageMapEntry* page_map, int page_map_level,
     return {num_4kpages, MAKE_ERROR(Error::kSuccess)};
 }
 
+Error MapSharedFrame(PageMapEntry* page_map, LinearAddress4Level addr,
+                     void* frame) {
+    for (int level = 4; level > 1; --level) {
+        auto& entry = page_map[addr.Part(level)];
+        auto [child_map, err] = SetNewPageMapIfNotPresent(entry);
+        if (err) {
+            return err;
+        }
+
+        entry.bits.user = 1;
+        entry.bits.writable = 1;
+        page_map = child_map;
+    }
+
+    auto& entry = page_map[addr.Part(1)];
+    if (entry.bits.present) {
+        return MAKE_ERROR(Error::kAlreadyAllocated);
+    }
+
+    entry.SetPointer(reinterpret_cast<PageMapEntry*>(frame));
+    entry.bits.present = 1;
+    entry.bits.writable = 1;
+    entry.bits.user = 1;
+    entry.bits.shared = 1;
+    return MAKE_ERROR(Error::kSuccess);
+}
+
 Error CleanPageMap(PageMapEntry* page_map, int page_map_level,
                    LinearAddress4Level addr) {
     for (int i = addr.Part(page_map_level); i < 512; i++) {
@@ -109,7 +136,7 @@ Error CleanPageMap(PageMapEntry* page_map, int page_map_level,
             }
         }
 
-        if (entry.bits.writable) {
+        if (entry.bits.writable && !entry.bits.shared) {
             const auto entry_addr =
                 reinterpret_cast<uintptr_t>(entry.Pointer());
             const FrameID map_frame{entry_addr / kBytesPerFrame};
@@ -194,6 +221,20 @@ Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages,
     return SetupPageMap(pml4_table, 4, addr, num_4kpages, writable).error;
 }
 
+Error MapSharedFrames(LinearAddress4Level addr, FrameID frame,
+                      size_t num_4kpages) {
+    auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+    for (size_t i = 0; i < num_4kpages; ++i) {
+        LinearAddress4Level page_addr{addr.value + i * kPageSize4K};
+        void* page_frame = FrameID{frame.ID() + i}.Frame();
+        if (auto err = MapSharedFrame(pml4_table, page_addr, page_frame)) {
+            return err;
+        }
+    }
+
+    return MAKE_ERROR(Error::kSuccess);
+}
+
 Error CleanPageMaps(LinearAddress4Level addr) {
     auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
     return CleanPageMap(pml4_table, 4, addr);
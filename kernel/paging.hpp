@@ -4,6 +4,7 @@
 #include <cstdint>
 
 #include "error.hpp"
+#include "memory_manager.hpp"
 
 const size_t kPageDirectoryCount = 64;
 
@@ -78,7 +79,9 @@ union PageMapEntry {
         uint64_t dirty : 1;
         uint64_t huge_page : 1;
         uint64_t global : 1;
-        uint64_t : 3;
+        // 共有メモリのフレーム．CleanPageMapsでは解放しない
+        uint64_t shared : 1;
+        uint64_t : 2;
 
         // 　下位の階層を指す物理アドレス
         uint64_t addr : 40;
@@ -98,6 +101,9 @@ WithError<PageMapEntry*> NewPageMap();
 Error FreePageMap(PageMapEntry* entry);
 Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages,
                     bool writable = true);
+// frameから始まる連続したフレームをaddrへ割り当てる．フレームは呼び出し側が管理する
+Error MapSharedFrames(LinearAddress4Level addr, FrameID frame,
+                      size_t num_4kpages);
 Error CleanPageMaps(LinearAddress4Level addr);
 Error CopyPageMaps(PageMapEntry* dst, PageMapEntry* src, int part, int start);
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr);
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "pipe.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+Pipe::Pipe() : buf_{new char[kBufferSize]} {}
+
+size_t Pipe::Read(void* buf, size_t len) {
+    auto bufc = reinterpret_cast<char*>(buf);
+    size_t pos = 0, copy_bytes = 0;
+    Task& task = task_manager->CurrentTask();
+    ScopedLock read_lock{read_mutex_};
+
+    // 終了を要求されたスレッドは何も読まずに戻る
+    readable_.WaitUntil([&] {
+        ScopedIRQLock lock{lock_};
+        if (size_ == 0) {
+            return write_closed_ || task.KillPending();
+        }
+
+        pos = head_;
+        copy_bytes = std::min(len, size_);
+        return true;
+    });
+    if (copy_bytes == 0) {
+        return 0;
+    }
+
+    // ページフォールトが起きてもよいよう，ロックを外して写す
+    CopyOut(pos, bufc, copy_bytes);
+
+    bool wake_writer;
+    {
+        ScopedIRQLock lock{lock_};
+        wake_writer = size_ == kBufferSize;
+        head_ = (head_ + copy_bytes) % kBufferSize;
+        size_ -= copy_bytes;
+    }
+
+    if (wake_writer) {
+        writable_.WakeAll();
+    }
+    return copy_bytes;
+}
+
+size_t Pipe::Write(const void* buf, size_t len) {
+    auto bufc = reinterpret_cast<const char*>(buf);
+    size_t written = 0;
+    Task& task = task_manager->CurrentTask();
+    ScopedLock write_lock{write_mutex_};
+
+    while (written < len) {
+        size_t pos = 0, copy_bytes = 0;
+        bool stop = false;
+        writable_.WaitUntil([&] {
+            ScopedIRQLock lock{lock_};
+            if (read_closed_ || task.KillPending()) {
+                stop = true;
+                return true;
+            }
+            if (size_ == kBufferSize) {
+                return false;
+            }
+
+            pos = (head_ + size_) % kBufferSize;
+            copy_bytes = std::min(len - written, kBufferSize - size_);
+            return true;
+        });
+        if (stop) {
+            break;
+        }
+
+        CopyIn(pos, &bufc[written], copy_bytes);
+        written += copy_bytes;
+
+        bool wake_reader;
+        {
+            ScopedIRQLock lock{lock_};
+            wake_reader = size_ == 0;
+            size_ += copy_bytes;
+        }
+
+        if (wake_reader) {
+            readable_.WakeAll();
+        }
+    }
+
+    return written;
+}
+
+void Pipe::CloseWrite() {
+    {
+        ScopedIRQLock lock{lock_};
+        write_closed_ = true;
+    }
+    readable_.WakeAll();
+}
+
+void Pipe::CloseRead() {
+    {
+        ScopedIRQLock lock{lock_};
+        read_closed_ = true;
+    }
+    writable_.WakeAll();
+}
+
+void Pipe::CopyIn(size_t pos, const char* src, size_t len) {
+    const size_t first = std::min(len, kBufferSize - pos);
+    memcpy(&buf_[pos], src, first);
+    memcpy(&buf_[0], &src[first], len - first);
+}
+
+void Pipe::CopyOut(size_t pos, char* dst, size_t len) {
+    const size_t first = std::min(len, kBufferSize - pos);
+    memcpy(dst, &buf_[pos], first);
+    memcpy(&dst[first], &buf_[0], len - first);
+}
+
+PipeDescriptor::PipeDescriptor(std::shared_ptr<Pipe> pipe, End end)
+    : pipe_{std::move(pipe)}, end_{end} {}
+
+PipeDescriptor::~PipeDescriptor() {
+    if (end_ == kReadEnd) {
+        pipe_->CloseRead();
+    } else {
+        pipe_->CloseWrite();
+    }
+}
+
+size_t PipeDescriptor::Read(void* buf, size_t len) {
+    if (end_ != kReadEnd) {
+        return 0;
+    }
+    return pipe_->Read(buf, len);
+}
+
+size_t PipeDescriptor::Write(const void* buf, size_t len) {
+    if (end_ != kWriteEnd) {
+        return 0;
+    }
+    return pipe_->Write(buf, len);
+}
+
+void PipeDescriptor::FinishWrite() { pipe_->CloseWrite(); }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "file.hpp"
+#include "lock.hpp"
+#include "task.hpp"
+
+// 書き込み側と読み出し側で共有するリングバッファ
+// 空から空でなくなったとき，満杯から空きができたときだけ相手を起こす
+class Pipe {
+   public:
+    static const size_t kBufferSize = 64 * 1024;
+
+    Pipe();
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+
+    // データが届くまで眠る．書き込み側が閉じられていて空なら0を返す
+    size_t Read(void* buf, size_t len);
+    // 全て書き込むまで眠る．読み出し側が閉じられたら書き込めた分だけを返す
+    size_t Write(const void* buf, size_t len);
+    void CloseWrite();
+    void CloseRead();
+
+   private:
+    // head_とsize_などを守る．割り込みを禁止して取るので，保持中にユーザのメモリは触らない
+    SpinLock lock_;
+    // ユーザのメモリとの間で写している間，読み出す側と書き込む側をそれぞれ1つにする
+    // 読み出し中の範囲はsize_に，書き込み中の範囲は空きに含まれたままなので相手は触らない
+    Mutex read_mutex_, write_mutex_;
+    std::unique_ptr<char[]> buf_;
+    size_t head_{0}, size_{0};
+    bool write_closed_{false}, read_closed_{false};
+    WaitQueue readable_, writable_;
+
+    void CopyIn(size_t pos, const char* src, size_t len);
+    void CopyOut(size_t pos, char* dst, size_t len);
+};
+
+// Pipeの片方の端．破棄されるとその端を閉じる
+class PipeDescriptor : public FileDescriptor {
+   public:
+    enum End { kReadEnd, kWriteEnd };
+
+    PipeDescriptor(std::shared_ptr<Pipe> pipe, End end);
+    ~PipeDescriptor() override;
+    size_t Read(void* buf, size_t len) override;
+    size_t Write(const void* buf, size_t len) override;
+    size_t Size() const override { return 0; }
+    size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
+
+    // 書き込み側を閉じて，読み出し側にEOFを伝える
+    void FinishWrite();
+
+   private:
+    std::shared_ptr<Pipe> pipe_;
+    End end_;
+};
@@ -0,0 +1,220 @@
+#include "pixel_kernel.hpp"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "fpu.hpp"
+#include "logger.hpp"
+
+namespace {
+const uint32_t kColorMask = 0x00ff'ffff;
+
+// 端数の画素はどの実装でもこれらで処理する
+uint32_t SwizzleOne(uint32_t v) {
+    return (v & 0xff00'ff00) | (v & 0xff) << 16 | (v >> 16 & 0xff);
+}
+
+uint32_t BlendOne(uint32_t s, uint32_t d) {
+    const uint32_t inv_alpha = 255 - (s >> 24);
+    uint32_t r = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t t = (d >> shift & 0xff) * inv_alpha + 128;
+        t = (t + (t >> 8)) >> 8;
+        const uint32_t c = (s >> shift & 0xff) + t;
+        r |= (c > 255 ? 255 : c) << shift;
+    }
+    return r;
+}
+
+void FillSSE2(uint32_t* dst, size_t n, uint32_t v) {
+    const __m128i vv = _mm_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), vv);
+    }
+    for (; i < n; ++i) {
+        dst[i] = v;
+    }
+}
+
+void BlitColorKeySSE2(uint32_t* dst, const uint32_t* src, size_t n,
+                      uint32_t key) {
+    const __m128i k = _mm_set1_epi32(key & kColorMask);
+    const __m128i cm = _mm_set1_epi32(kColorMask);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        const auto transparent = _mm_cmpeq_epi32(_mm_and_si128(s, cm), k);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_or_si128(_mm_and_si128(transparent, d),
+                                      _mm_andnot_si128(transparent, s)));
+    }
+    for (; i < n; ++i) {
+        if ((src[i] & kColorMask) != (key & kColorMask)) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+void SwizzleSSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m128i ga = _mm_set1_epi32(0xff00'ff00);
+    const __m128i lo = _mm_set1_epi32(0xff);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const auto rb = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, lo), 16),
+                                     _mm_and_si128(_mm_srli_epi32(v, 16), lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_or_si128(_mm_and_si128(v, ga), rb));
+    }
+    for (; i < n; ++i) {
+        dst[i] = SwizzleOne(src[i]);
+    }
+}
+
+// 16ビットに広げた2画素分を合成する
+__m128i BlendHalfSSE2(__m128i s16, __m128i d16) {
+    const auto alpha = _mm_shufflehi_epi16(
+        _mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3));
+    const auto inv_alpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    auto t = _mm_add_epi16(_mm_mullo_epi16(d16, inv_alpha), _mm_set1_epi16(128));
+    // tを255で割る
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    return _mm_add_epi16(s16, t);
+}
+
+void BlendSSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        const auto lo = BlendHalfSSE2(_mm_unpacklo_epi8(s, zero),
+                                      _mm_unpacklo_epi8(d, zero));
+        const auto hi = BlendHalfSSE2(_mm_unpackhi_epi8(s, zero),
+                                      _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_packus_epi16(lo, hi));
+    }
+    for (; i < n; ++i) {
+        dst[i] = BlendOne(src[i], dst[i]);
+    }
+}
+
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+AVX2_FUNC void FillAVX2(uint32_t* dst, size_t n, uint32_t v) {
+    const __m256i vv = _mm256_set1_epi32(v);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), vv);
+    }
+    FillSSE2(dst + i, n - i, v);
+}
+
+AVX2_FUNC void BlitColorKeyAVX2(uint32_t* dst, const uint32_t* src, size_t n,
+                                uint32_t key) {
+    const __m256i k = _mm256_set1_epi32(key & kColorMask);
+    const __m256i cm = _mm256_set1_epi32(kColorMask);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const auto s =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const auto d =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        const auto transparent = _mm256_cmpeq_epi32(_mm256_and_si256(s, cm), k);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_blendv_epi8(s, d, transparent));
+    }
+    BlitColorKeySSE2(dst + i, src + i, n - i, key);
+}
+
+AVX2_FUNC void SwizzleAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+    // 各画素の0バイト目と2バイト目を入れ替える
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,  //
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const auto v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_shuffle_epi8(v, shuffle));
+    }
+    SwizzleSSE2(dst + i, src + i, n - i);
+}
+
+AVX2_FUNC __m256i BlendHalfAVX2(__m256i s16, __m256i d16) {
+    const auto alpha = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3));
+    const auto inv_alpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    auto t = _mm256_add_epi16(_mm256_mullo_epi16(d16, inv_alpha),
+                              _mm256_set1_epi16(128));
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    return _mm256_add_epi16(s16, t);
+}
+
+AVX2_FUNC void BlendAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const auto s =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const auto d =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        // unpackとpackusは128ビットごとに働くので，画素の順番は変わらない
+        const auto lo = BlendHalfAVX2(_mm256_unpacklo_epi8(s, zero),
+                                      _mm256_unpacklo_epi8(d, zero));
+        const auto hi = BlendHalfAVX2(_mm256_unpackhi_epi8(s, zero),
+                                      _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_packus_epi16(lo, hi));
+    }
+    BlendSSE2(dst + i, src + i, n - i);
+}
+
+#undef AVX2_FUNC
+
+struct PixelKernels {
+    void (*fill)(uint32_t*, size_t, uint32_t);
+    void (*blit_color_key)(uint32_t*, const uint32_t*, size_t, uint32_t);
+    void (*swizzle)(uint32_t*, const uint32_t*, size_t);
+    void (*blend)(uint32_t*, const uint32_t*, size_t);
+};
+
+// x86-64ではSSE2は必ず使える
+PixelKernels kernels{FillSSE2, BlitColorKeySSE2, SwizzleSSE2, BlendSSE2};
+}  // namespace
+
+void InitializePixelKernels() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!FPUAVXEnabled() || __get_cpuid_max(0, nullptr) < 7) {
+        return;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (ebx & bit_AVX2) {
+        kernels = {FillAVX2, BlitColorKeyAVX2, SwizzleAVX2, BlendAVX2};
+        Log(kInfo, "pixel kernels: AVX2\n");
+    }
+}
+
+void FillPixels(uint32_t* dst, size_t n, uint32_t v) {
+    kernels.fill(dst, n, v);
+}
+
+void BlitColorKeyPixels(uint32_t* dst, const uint32_t* src, size_t n,
+                        uint32_t key) {
+    kernels.blit_color_key(dst, src, n, key);
+}
+
+void SwizzlePixels(uint32_t* dst, const uint32_t* src, size_t n) {
+    kernels.swizzle(dst, src, n);
+}
+
+void BlendPixels(uint32_t* dst, const uint32_t* src, size_t n) {
+    kernels.blend(dst, src, n);
+}
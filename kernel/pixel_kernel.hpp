@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 32ビット画素の列をまとめて処理する関数
+// CPUの機能に応じてSSE2かAVX2の実装を使う．下位24ビットが色，最上位バイトは予約かアルファ
+
+// SSE2版で動き始め，使えればAVX2版に切り替える．InitializeFPUの後に呼ぶ
+void InitializePixelKernels();
+
+void FillPixels(uint32_t* dst, size_t n, uint32_t v);
+// 色がkeyと等しい画素を透明とみなし，それ以外をコピーする
+void BlitColorKeyPixels(uint32_t* dst, const uint32_t* src, size_t n,
+                        uint32_t key);
+// RGBとBGRを相互に変換しながらコピーする
+void SwizzlePixels(uint32_t* dst, const uint32_t* src, size_t n);
+// srcはアルファを乗算済みの画素．dst = src + dst * (255 - alpha) / 255
+void BlendPixels(uint32_t* dst, const uint32_t* src, size_t n);
@@ -0,0 +1,56 @@
+#include "shared_memory.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "lock.hpp"
+
+namespace {
+// 名前から探すための一覧．誰も割り当てていない共有メモリは消える
+std::vector<std::weak_ptr<SharedMemory>> shared_memories;
+Mutex shared_memories_mutex;
+}  // namespace
+
+SharedMemory::SharedMemory(const char* name, FrameID base, size_t num_frames)
+    : base_{base}, num_frames_{num_frames} {
+    strncpy(name_, name, kMaxNameLen);
+    name_[kMaxNameLen] = '\0';
+}
+
+SharedMemory::~SharedMemory() { memory_manager->Free(base_, num_frames_); }
+
+WithError<std::shared_ptr<SharedMemory>> OpenSharedMemory(const char* name,
+                                                          size_t bytes,
+                                                          bool create) {
+    ScopedLock lock{shared_memories_mutex};
+
+    for (auto it = shared_memories.begin(); it != shared_memories.end();) {
+        auto shm = it->lock();
+        if (!shm) {
+            it = shared_memories.erase(it);
+            continue;
+        }
+        if (strncmp(shm->Name(), name, SharedMemory::kMaxNameLen) == 0) {
+            return {shm, MAKE_ERROR(Error::kSuccess)};
+        }
+        ++it;
+    }
+
+    if (!create) {
+        return {nullptr, MAKE_ERROR(Error::kNoSuchEntry)};
+    }
+    if (bytes == 0) {
+        return {nullptr, MAKE_ERROR(Error::kInvalidFormat)};
+    }
+
+    const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+    auto [frame, err] = memory_manager->Allocate(num_frames);
+    if (err) {
+        return {nullptr, err};
+    }
+    memset(frame.Frame(), 0, num_frames * kBytesPerFrame);
+
+    auto shm = std::make_shared<SharedMemory>(name, frame, num_frames);
+    shared_memories.push_back(shm);
+    return {shm, MAKE_ERROR(Error::kSuccess)};
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "error.hpp"
+#include "memory_manager.hpp"
+
+// 名前で開ける共有メモリ．同じ物理フレームを複数のプロセスへ割り当てる
+// 最後の参照が無くなるとフレームを解放する
+class SharedMemory {
+   public:
+    static const size_t kMaxNameLen = 15;
+
+    SharedMemory(const char* name, FrameID base, size_t num_frames);
+    ~SharedMemory();
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    const char* Name() const { return name_; }
+    FrameID Base() const { return base_; }
+    size_t NumFrames() const { return num_frames_; }
+    size_t Bytes() const { return num_frames_ * kBytesPerFrame; }
+    uint64_t PhysAddr() const { return base_.ID() * kBytesPerFrame; }
+
+   private:
+    char name_[kMaxNameLen + 1];
+    FrameID base_;
+    size_t num_frames_;
+};
+
+// プロセスに割り当てた共有メモリの範囲
+struct SharedMapping {
+    std::shared_ptr<SharedMemory> shm;
+    uint64_t vaddr_begin, vaddr_end;
+};
+
+// nameの共有メモリを開く．無ければcreateのときだけbytesの大きさで作る
+WithError<std::shared_ptr<SharedMemory>> OpenSharedMemory(const char* name,
+                                                          size_t bytes,
+                                                          bool create);
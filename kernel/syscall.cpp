@@ -2,6 +2,7 @@
 
 #include <fcntl.h>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
 #include <cmath>
@@ -9,11 +10,17 @@
 
 #include "app_event.hpp"
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "console.hpp"
 #include "fat.hpp"
 #include "font.hpp"
+#include "futex.hpp"
 #include "keyboard.hpp"
+#include "latency.hpp"
 #include "msr.hpp"
+#include "paging.hpp"
+#include "shared_memory.hpp"
+#include "syscall_ring.hpp"
 #include "task.hpp"
 #include "terminal.hpp"
 #include "timer.hpp"
@@ -50,9 +57,7 @@ SYSCALL(PutString) {
         return {0, E2BIG};
     }
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
 
     if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
         return {0, EBADF};
@@ -62,9 +67,7 @@ SYSCALL(PutString) {
 }
 
 SYSCALL(Exit) {
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
     return {task.OSStackPointer(), static_cast<int>(arg1)};
 }
 
@@ -74,17 +77,16 @@ SYSCALL(OpenWindow) {
     const auto window = std::make_shared<ToplevelWindow>(
         w, h, screen_config.pixel_format, title);
 
-    __asm__("cli");
+    const auto task_id = task_manager->CurrentTask().ID();
+
+    ScopedLock lock{layer_mutex};
     const auto layer_id = layer_manager->NewLayer()
                               .SetWindow(window)
                               .SetDraggable(true)
                               .Move({x, y})
                               .ID();
     active_layer->Activate(layer_id);
-
-    const auto task_id = task_manager->CurrentTask().ID();
     layer_task_map->insert(std::make_pair(layer_id, task_id));
-    __asm__("sti");
 
     return {layer_id, 0};
 }
@@ -95,23 +97,26 @@ Result DoWindowFunc(Func f, uint64_t layer_id_flags, Args... args) {
     const uint32_t layer_flags = layer_id_flags >> 32;
     const unsigned int layer_id = layer_id_flags & 0xffffffff;
 
-    __asm__("cli");
-    auto layer = layer_manager->FindLayer(layer_id);
-    __asm__("sti");
-
-    if (layer == nullptr) {
-        return {0, EBADF};
+    std::shared_ptr<Window> window;
+    {
+        ScopedLock lock{layer_mutex};
+        auto layer = layer_manager->FindLayer(layer_id);
+        if (layer == nullptr) {
+            return {0, EBADF};
+        }
+        window = layer->GetWindow();
     }
 
-    const auto res = f(*layer->GetWindow(), args...);
+    // ウィンドウへの描画中はロックを保持しない
+    const auto res = f(*window, args...);
     if (res.error) {
         return res;
     }
 
     if ((layer_flags & 1) == 0) {
-        __asm__("cli");
-        layer_manager->Draw(layer_id);
-        __asm__("sti");
+        ScopedLock lock{layer_mutex};
+        layer_manager->AddDamage(layer_id);
+        RequestCompose(task_manager->CurrentTask().ID());
     }
 
     return res;
@@ -191,6 +196,8 @@ SYSCALL(WinDrawLine) {
 
 SYSCALL(CloseWindow) {
     const unsigned int layer_id = arg1 & 0xffffffff;
+
+    ScopedLock lock{layer_mutex};
     const auto layer = layer_manager->FindLayer(layer_id);
 
     if (layer == nullptr) {
@@ -200,12 +207,10 @@ SYSCALL(CloseWindow) {
     const auto layer_pos = layer->GetPosition();
     const auto win_size = layer->GetWindow()->Size();
 
-    __asm__("cli");
     active_layer->Activate(0);
     layer_manager->RemoveLayer(layer_id);
     layer_manager->Draw({layer_pos, win_size});
     layer_task_map->erase(layer_id);
-    __asm__("sti");
 
     return {0, 0};
 }
@@ -218,20 +223,14 @@ SYSCALL(ReadEvent) {
     const auto app_events = reinterpret_cast<AppEvent *>(arg1);
     const size_t len = arg2;
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
     size_t i = 0;
 
     while (i < len) {
-        __asm__("cli");
-        auto msg = task.ReceiveMessage();
+        auto msg = i == 0 ? task.WaitMessage() : task.ReceiveMessage();
         if (!msg && i == 0) {
-            task.Sleep();
-            continue;
+            return {0, EINTR};
         }
-        __asm__("sti");
-
         if (!msg) {
             break;
         }
@@ -306,22 +305,40 @@ SYSCALL(CreateTimer) {
         return {0, EINVAL};
     }
 
-    __asm__("cli");
     const uint64_t task_id = task_manager->CurrentTask().ID();
-    __asm__("sti");
 
     unsigned long timeout = arg3 * kTimerFreq / 1000;
     if (mode & 1) {
         timeout += timer_manager->CurrentTick();
     }
 
-    __asm__("cli");
-    timer_manager->AddTimer(Timer{timeout, -timer_value, task_id});
-    __asm__("sti");
+    const auto timer_id =
+        timer_manager->AddTimer(Timer{timeout, -timer_value, task_id});
+
+    if (timer_id == kInvalidTimerID) {
+        return {0, EAGAIN};
+    }
+
+    if (arg4 >= 0x8000'0000'0000'0000) {
+        *reinterpret_cast<uint64_t *>(arg4) = timer_id;
+    }
 
     return {timeout * 1000 / kTimerFreq, 0};
 }
 
+SYSCALL(CancelTimer) {
+    const TimerID timer_id = arg1;
+
+    const uint64_t task_id = task_manager->CurrentTask().ID();
+    const auto err = timer_manager->CancelTimer(timer_id, task_id);
+
+    if (err) {
+        return {0, ENOENT};
+    }
+
+    return {0, 0};
+}
+
 namespace {
 size_t AllocateFD(Task &task) {
     const size_t num_files = task.Files().size();
@@ -354,9 +371,7 @@ SYSCALL(OpenFile) {
     const char *path = reinterpret_cast<const char *>(arg1);
     const int flags = arg2;
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
 
     if (strcmp(path, "stdin") == 0) {
         return {0, 0};
@@ -378,8 +393,10 @@ SYSCALL(OpenFile) {
         return {0, ENOENT};
     }
 
+    auto file_fd = std::make_shared<fat::FileDescriptor>(*file);
+    ScopedIRQLock lock{task.GetProcess().Lock()};
     size_t fd = AllocateFD(task);
-    task.Files()[fd] = std::make_unique<fat::FileDescriptor>(*file);
+    task.Files()[fd] = file_fd;
 
     return {fd, 0};
 }
@@ -389,9 +406,7 @@ SYSCALL(ReadFile) {
     void *buf = reinterpret_cast<void *>(arg2);
     size_t count = arg3;
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
 
     if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
         return {0, EBADF};
@@ -403,10 +418,9 @@ SYSCALL(ReadFile) {
 SYSCALL(DemandPages) {
     const size_t num_pages = arg1;
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
 
+    ScopedIRQLock lock{task.GetProcess().Lock()};
     const uint64_t dpaging_end = task.DPagingEnd();
     task.SetDPagingEnd(dpaging_end + num_pages * 4096);
 
@@ -417,39 +431,293 @@ SYSCALL(MapFile) {
     const int fd = arg1;
     size_t *file_size = reinterpret_cast<size_t *>(arg2);
 
-    __asm__("cli");
     auto &task = task_manager->CurrentTask();
-    __asm__("sti");
 
     if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
         return {0, EBADF};
     }
 
-    *file_size = task.Files()[fd]->Size();
+    const size_t size = task.Files()[fd]->Size();
+    *file_size = size;
+
+    ScopedIRQLock lock{task.GetProcess().Lock()};
     const uint64_t vaddr_end = task.FileMapEnd();
-    const uint64_t vaddr_begin =
-        (vaddr_end - *file_size) & 0xffff'ffff'ffff'f000;
+    const uint64_t vaddr_begin = (vaddr_end - size) & 0xffff'ffff'ffff'f000;
 
     task.SetFileMapEnd(vaddr_begin);
     task.FileMaps().push_back(FileMapping{fd, vaddr_begin, vaddr_end});
     return {vaddr_begin, 0};
 }
 
+namespace {
+struct ThreadStart {
+    uint64_t entry, arg, stack_top;
+};
+
+void TaskAppThread(uint64_t task_id, int64_t data) {
+    const auto start = reinterpret_cast<ThreadStart *>(data);
+    const auto [entry, arg, stack_top] = *start;
+    delete start;
+
+    auto &task = task_manager->CurrentTask();
+    // スレッドがExitを呼ぶとここへ戻ってくる
+    const int ret = CallThread(arg, 0, 3 << 3 | 3, entry, stack_top,
+                               &task.OSStackPointer());
+    task_manager->Finish(ret);
+}
+}  // namespace
+
+SYSCALL(CreateThread) {
+    const uint64_t entry = arg1, arg = arg2, stack_top = arg3;
+    if (entry < 0x8000'0000'0000'0000 || stack_top < 0x8000'0000'0000'0000) {
+        return {0, EFAULT};
+    }
+
+    auto &task = task_manager->CurrentTask();
+    auto &thread = task_manager->NewTask().ShareProcess(task);
+    task_manager->SetNice(thread.ID(), task.Nice());
+    {
+        ScopedIRQLock lock{task.GetProcess().Lock()};
+        task.GetProcess().Threads().push_back(thread.ID());
+    }
+
+    // 関数の入口と同じく，RSP + 8 が16バイト境界になるようにする
+    auto start = new ThreadStart{entry, arg, (stack_top & ~0xful) - 8};
+    thread.InitContext(TaskAppThread, reinterpret_cast<int64_t>(start))
+        .Wakeup();
+
+    return {thread.ID(), 0};
+}
+
+SYSCALL(JoinThread) {
+    const uint64_t thread_id = arg1;
+    auto &task = task_manager->CurrentTask();
+    auto &process = task.GetProcess();
+
+    auto find_thread = [&process, thread_id]() {
+        auto &threads = process.Threads();
+        return std::find(threads.begin(), threads.end(), thread_id);
+    };
+
+    {
+        ScopedIRQLock lock{process.Lock()};
+        if (thread_id == task.ID() || find_thread() == process.Threads().end()) {
+            return {0, ESRCH};
+        }
+    }
+
+    // 待っている間もプロセス終了時に止められるよう，一覧からは後で外す
+    auto [exit_code, err] = task_manager->WaitFinish(thread_id);
+    if (err) {
+        return {0, ESRCH};
+    }
+
+    ScopedIRQLock lock{process.Lock()};
+    if (auto it = find_thread(); it != process.Threads().end()) {
+        process.Threads().erase(it);
+    }
+    return {static_cast<uint64_t>(exit_code), 0};
+}
+
+SYSCALL(Futex) {
+    const auto addr = reinterpret_cast<uint32_t *>(arg1);
+    const int op = arg2;
+    const uint32_t val = arg3;
+    if (arg1 < 0x8000'0000'0000'0000 || (arg1 & 3) != 0) {
+        return {0, EFAULT};
+    }
+
+    switch (op) {
+        case kFutexWait:
+            if (auto err = FutexWait(addr, val)) {
+                return {0, err.Cause() == Error::kTryAgain ? EAGAIN : EINTR};
+            }
+            return {0, 0};
+        case kFutexWake:
+            return {static_cast<uint64_t>(FutexWake(addr, val)), 0};
+        case kFutexRequeue:
+        case kFutexCmpRequeue: {
+            const auto addr2 = reinterpret_cast<uint32_t *>(arg5);
+            if (arg5 < 0x8000'0000'0000'0000 || (arg5 & 3) != 0) {
+                return {0, EFAULT};
+            }
+            std::optional<uint32_t> expected;
+            if (op == kFutexCmpRequeue) {
+                expected = arg6;
+            }
+            auto [n, err] = FutexRequeue(addr, val, addr2, arg4, expected);
+            if (err) {
+                return {0, EAGAIN};
+            }
+            return {static_cast<uint64_t>(n), 0};
+        }
+        default:
+            return {0, EINVAL};
+    }
+}
+
+SYSCALL(OpenSharedMemory) {
+    const char *name = reinterpret_cast<const char *>(arg1);
+    size_t *size = reinterpret_cast<size_t *>(arg2);
+    const int flags = arg3;
+
+    if (strlen(name) > SharedMemory::kMaxNameLen) {
+        return {0, ENAMETOOLONG};
+    }
+
+    auto [shm, err] = ::OpenSharedMemory(name, *size, flags & O_CREAT);
+    switch (err.Cause()) {
+        case Error::kSuccess:
+            break;
+        case Error::kNoSuchEntry:
+            return {0, ENOENT};
+        case Error::kInvalidFormat:
+            return {0, EINVAL};
+        default:
+            return {0, ENOMEM};
+    }
+    *size = shm->Bytes();
+
+    auto &task = task_manager->CurrentTask();
+    uint64_t vaddr_begin;
+    {
+        // ロック中は仮想アドレスの範囲を確保して記録するだけにする
+        // 途中まで割り当てたページも終了時に解放されるよう，割り当て前に記録する
+        ScopedIRQLock lock{task.GetProcess().Lock()};
+        const uint64_t vaddr_end = task.FileMapEnd();
+        vaddr_begin = vaddr_end - shm->Bytes();
+        task.SetFileMapEnd(vaddr_begin);
+        task.GetProcess().SharedMaps().push_back(
+            SharedMapping{shm, vaddr_begin, vaddr_end});
+    }
+
+    // 全プロセスで同じフレームを指すので，ページフォールトを待たずに割り当てる
+    // ページ数に比例して時間がかかるので，割り込みを許可したまま行う
+    if (MapSharedFrames(LinearAddress4Level{vaddr_begin}, shm->Base(),
+                        shm->NumFrames())) {
+        return {0, ENOMEM};
+    }
+    return {vaddr_begin, 0};
+}
+
+// リングの要求を1つ実行する．syscall_tableの後ろで定義する
+Result CallRingEntry(uint32_t number, const uint64_t *args);
+
+namespace {
+// 第1引数にlayer_id_flagsを取り，描画後にレイヤを再描画するシステムコール
+bool IsWindowFunc(uint32_t number) {
+    switch (number) {
+        case 0x8000'0004:  // WinWriteString
+        case 0x8000'0005:  // WinFillRectangle
+        case 0x8000'0007:  // WinRedraw
+        case 0x8000'0008:  // WinDrawLine
+            return true;
+        default:
+            return false;
+    }
+}
+
+const uint64_t kLayerNoRedraw = 1ull << 32;
+}  // namespace
+
+SYSCALL(SubmitRing) {
+    if (arg1 < 0x8000'0000'0000'0000) {
+        return {0, EFAULT};
+    }
+
+    auto ring = reinterpret_cast<SyscallRing *>(arg1);
+    const size_t to_submit = arg2;
+
+    // 再描画は要求ごとではなく，最後にレイヤごとに1回だけ行う
+    std::array<unsigned int, 8> redraw_layers;
+    size_t num_redraw = 0;
+    auto find_redraw = [&](unsigned int layer_id) {
+        return std::find(redraw_layers.begin(),
+                         redraw_layers.begin() + num_redraw, layer_id) !=
+               redraw_layers.begin() + num_redraw;
+    };
+
+    size_t submitted = 0;
+    while (submitted < to_submit && ring->sq_head != ring->sq_tail) {
+        // 完了を書き込めないうちは次の要求を取り出さない
+        if (ring->cq_tail - ring->cq_head >= SYSCALL_RING_ENTRIES) {
+            break;
+        }
+
+        const SyscallRingEntry entry =
+            ring->sq[ring->sq_head % SYSCALL_RING_ENTRIES];
+        ++ring->sq_head;
+        ++submitted;
+
+        uint64_t args[6];
+        std::copy(std::begin(entry.args), std::end(entry.args), args);
+
+        bool defer_redraw = false;
+        const unsigned int layer_id = args[0] & 0xffffffff;
+        if (IsWindowFunc(entry.number) && (args[0] & kLayerNoRedraw) == 0 &&
+            (find_redraw(layer_id) || num_redraw < redraw_layers.size())) {
+            args[0] |= kLayerNoRedraw;
+            defer_redraw = true;
+        }
+
+        const auto res = CallRingEntry(entry.number, args);
+        if (defer_redraw && !res.error && !find_redraw(layer_id)) {
+            redraw_layers[num_redraw++] = layer_id;
+        }
+
+        if (res.error || (entry.flags & SYSCALL_RING_SKIP_SUCCESS) == 0) {
+            auto &cqe = ring->cq[ring->cq_tail % SYSCALL_RING_ENTRIES];
+            cqe.user_data = entry.user_data;
+            cqe.value = res.value;
+            cqe.error = res.error;
+            ++ring->cq_tail;
+        }
+    }
+
+    if (num_redraw > 0) {
+        ScopedLock lock{layer_mutex};
+        for (size_t i = 0; i < num_redraw; ++i) {
+            layer_manager->AddDamage(redraw_layers[i]);
+        }
+        RequestCompose(task_manager->CurrentTask().ID());
+    }
+
+    return {submitted, 0};
+}
+
 #undef SYSCALL
 }  // namespace syscall
 
 using SyscallFuncType = syscall::Result(uint64_t, uint64_t, uint64_t, uint64_t,
                                         uint64_t, uint64_t);
 
-extern "C" std::array<SyscallFuncType *, 0x10> syscall_table{
+extern "C" std::array<SyscallFuncType *, 0x16> syscall_table{
     syscall::LogString,      syscall::PutString,      syscall::Exit,
     syscall::OpenWindow,     syscall::WinWriteString, syscall::WinFillRectangle,
     syscall::GetCurrentTick, syscall::WinRedraw,      syscall::WinDrawLine,
     syscall::CloseWindow,    syscall::ReadEvent,      syscall::CreateTimer,
     syscall::OpenFile,       syscall::ReadFile,       syscall::DemandPages,
-    syscall::MapFile,
+    syscall::MapFile,        syscall::CancelTimer,    syscall::CreateThread,
+    syscall::JoinThread,     syscall::Futex,          syscall::OpenSharedMemory,
+    syscall::SubmitRing,
 };
 
+namespace syscall {
+Result CallRingEntry(uint32_t number, const uint64_t *args) {
+    const uint32_t index = number & 0x7fff'ffff;
+    if ((number & 0x8000'0000) == 0 || index >= syscall_table.size()) {
+        return {0, ENOSYS};
+    }
+
+    // Exitは呼び出し元のスタックへ直接戻るので，リングからは呼べない
+    const auto func = syscall_table[index];
+    if (func == Exit || func == SubmitRing) {
+        return {0, EINVAL};
+    }
+    return func(args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+}  // namespace syscall
+
 void InitializeSysCall() {
     // syscall命令を有効化
     WriteMSR(kIA32_EFER, 0x0501u);
@@ -0,0 +1,39 @@
+#pragma once
+
+// アプリとOSが共有するシステムコールの投入リングと完了リング
+// アプリはsqへ要求を積んでsq_tailを進め，SubmitRingで一度にまとめて処理させる
+// OSはsq_headを進め，結果をcqへ積んでcq_tailを進める．アプリはcq_headを進めて読み捨てる
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYSCALL_RING_ENTRIES 256
+
+// 成功したときは完了リングに積まない．大量の描画要求に使う
+#define SYSCALL_RING_SKIP_SUCCESS 0x1
+
+struct SyscallRingEntry {
+    uint32_t number;  // 0x80000000から始まるシステムコール番号
+    uint32_t flags;
+    uint64_t args[6];
+    uint64_t user_data;  // 完了リングへそのまま返す
+};
+
+struct SyscallRingCompletion {
+    uint64_t user_data;
+    uint64_t value;
+    int32_t error;
+    int32_t reserved;
+};
+
+struct SyscallRing {
+    uint32_t sq_head, sq_tail;
+    uint32_t cq_head, cq_tail;
+    struct SyscallRingEntry sq[SYSCALL_RING_ENTRIES];
+    struct SyscallRingCompletion cq[SYSCALL_RING_ENTRIES];
+};
+
+#ifdef __cplusplus
+}
+#endif
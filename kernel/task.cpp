@@ -1,15 +1,36 @@
 #include "task.hpp"
 
+#include <csignal>
+
 #include "asmfunc.h"
 #include "fat.hpp"
 #include "segment.hpp"
 #include "timer.hpp"
 
 namespace {
-template <class T, class U>
-void Erase(T& c, const U& value) {
-    auto it = std::remove(c.begin(), c.end(), value);
-    c.erase(it, c.end());
+// nice値 -20〜19 に対応する重み．nice値が1違うとCPU時間の比がおよそ1.25倍になる
+const std::array<uint32_t, Task::kMaxNice - Task::kMinNice + 1> kNiceToWeight =
+    {
+        88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+        9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+        1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+        110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+const uint32_t kNice0Weight = 1024;
+
+uint32_t NiceToWeight(int nice) { return kNiceToWeight[nice - Task::kMinNice]; }
+
+// 眠っていたタスクが起きたときに優遇するvruntimeの幅 (タイムスライスの半分)
+uint64_t SleeperCredit() {
+    return lapic_timer_freq / kTimerFreq * kTaskTimerPeriod / 2;
+}
+
+// 入力を処理し終えずに実行し続けても，この期間が過ぎたら元のレベルへ戻す
+const unsigned long kBoostPeriod = kTaskTimerPeriod * 2;
+
+bool IsInputMessage(Message::Type type) {
+    return type == Message::kKeyPush || type == Message::kMouseMove ||
+           type == Message::kMouseButton;
 }
 }  // namespace
 
@@ -19,7 +40,8 @@ void TaskIdle(uint64_t task_id, int64_t data) {
     }
 }  // namespace
 
-Task::Task(uint64_t id) : id_{id}, msgs_{} {}
+Task::Task(uint64_t id)
+    : id_{id}, process_{std::make_shared<Process>()} {}
 
 Task& Task::InitContext(TaskFunc* f, int64_t data) {
     const size_t stack_size = kDefaultStackBytes / sizeof(stack_[0]);
@@ -38,7 +60,7 @@ Task& Task::InitContext(TaskFunc* f, int64_t data) {
     context_.rdi = id_;
     context_.rsi = data;
 
-    *reinterpret_cast<uint32_t*>(&context_.fxsave_area[24]) = 0x1f80;
+    *reinterpret_cast<uint32_t*>(&context_.fpu_area[24]) = 0x1f80;
 
     return *this;
 }
@@ -60,167 +82,431 @@ Task& Task::Wakeup() {
 }
 
 void Task::SendMessage(const Message& msg) {
-    msgs_.push_back(msg);
-    Wakeup();
+    task_manager->SendMessage(id_, msg);
 }
 
-std::optional<Message> Task::ReceiveMessage() {
-    if (msgs_.empty()) {
-        return std::nullopt;
+std::optional<Message> Task::ReceiveMessage(MessageFilter* filter) {
+    // 読み飛ばしたメッセージの方がキューに残っているものより古い
+    auto it = deferred_msgs_.begin();
+    if (filter) {
+        it = std::find_if(deferred_msgs_.begin(), deferred_msgs_.end(), filter);
+    }
+    if (it != deferred_msgs_.end()) {
+        auto msg = *it;
+        deferred_msgs_.erase(it);
+        return msg;
     }
 
-    auto msg = msgs_.front();
-    msgs_.pop_front();
+    while (auto msg = msgs_.Pop()) {
+        if (filter == nullptr || filter(*msg)) {
+            return msg;
+        }
+        deferred_msgs_.push_back(*msg);
+    }
+    return std::nullopt;
+}
+
+std::optional<Message> Task::WaitMessage(MessageFilter* filter) {
+    std::optional<Message> msg;
+    msgs_wait_.WaitUntil([this, filter, &msg] {
+        msg = ReceiveMessage(filter);
+        return msg || kill_pending_;
+    });
     return msg;
 }
 
-std::vector<std::shared_ptr<FileDescriptor>>& Task::Files() { return files_; }
+bool Task::PushMessage(const Message& msg) { return msgs_.Push(msg); }
+
+std::vector<std::shared_ptr<FileDescriptor>>& Task::Files() {
+    return process_->Files();
+}
+
+uint64_t Task::DPagingBegin() const { return process_->DPagingBegin(); }
+
+void Task::SetDPagingBegin(uint64_t v) { process_->SetDPagingBegin(v); }
+
+uint64_t Task::DPagingEnd() const { return process_->DPagingEnd(); }
+
+void Task::SetDPagingEnd(uint64_t v) { process_->SetDPagingEnd(v); }
+
+uint64_t Task::FileMapEnd() const { return process_->FileMapEnd(); }
+
+void Task::SetFileMapEnd(uint64_t v) { process_->SetFileMapEnd(v); }
+
+std::vector<FileMapping>& Task::FileMaps() { return process_->FileMaps(); }
+
+Task& Task::ShareProcess(Task& owner) {
+    process_ = owner.process_;
+    return *this;
+}
+
+FairRunQueue::FairRunQueue() { heap_.reserve(64); }
 
-uint64_t Task::DPagingBegin() const { return dpaging_begin_; }
+void FairRunQueue::Push(Task* task) {
+    task->fair_index_ = heap_.size();
+    heap_.push_back(task);
+    SiftUp(task->fair_index_);
+}
 
-void Task::SetDPagingBegin(uint64_t v) { dpaging_begin_ = v; }
+void FairRunQueue::Erase(Task* task) {
+    const size_t i = task->fair_index_;
+    if (i >= heap_.size() || heap_[i] != task) {
+        return;
+    }
 
-uint64_t Task::DPagingEnd() const { return dpaging_end_; }
+    Swap(i, heap_.size() - 1);
+    heap_.pop_back();
+    if (i < heap_.size()) {
+        SiftUp(i);
+        SiftDown(heap_[i]->fair_index_);
+    }
+}
 
-void Task::SetDPagingEnd(uint64_t v) { dpaging_end_ = v; }
+void FairRunQueue::Update(Task* task) {
+    SiftUp(task->fair_index_);
+    SiftDown(task->fair_index_);
+}
 
-uint64_t Task::FileMapEnd() const { return file_map_end_; }
+bool FairRunQueue::Less(size_t a, size_t b) const {
+    return heap_[a]->vruntime_ < heap_[b]->vruntime_;
+}
 
-void Task::SetFileMapEnd(uint64_t v) { file_map_end_ = v; }
+void FairRunQueue::Swap(size_t a, size_t b) {
+    std::swap(heap_[a], heap_[b]);
+    heap_[a]->fair_index_ = a;
+    heap_[b]->fair_index_ = b;
+}
 
-std::vector<FileMapping>& Task::FileMaps() { return file_maps_; }
+void FairRunQueue::SiftUp(size_t i) {
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+        if (!Less(i, parent)) {
+            break;
+        }
+        Swap(i, parent);
+        i = parent;
+    }
+}
+
+void FairRunQueue::SiftDown(size_t i) {
+    while (true) {
+        size_t min = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2; ++child) {
+            if (child < heap_.size() && Less(child, min)) {
+                min = child;
+            }
+        }
+        if (min == i) {
+            break;
+        }
+        Swap(i, min);
+        i = min;
+    }
+}
 
 TaskManager::TaskManager() {
-    Task& task = NewTask().SetLevel(current_level_).SetRunning(true);
-    running_[current_level_].push_back(&task);
+    Task& task = NewTask().SetLevel(kMaxLevel).SetRunning(true);
+    running_[kMaxLevel].PushBack(&task);
+    current_task_ = &task;
 
     Task& idle =
         NewTask().InitContext(TaskIdle, 0).SetLevel(0).SetRunning(true);
-    running_[0].push_back(&idle);
+    running_[0].PushBack(&idle);
 }
 
 Task& TaskManager::NewTask() {
+    ScopedIRQLock lock{lock_};
     ++latest_id_;
-    return *tasks_.emplace_back(new Task{latest_id_});
+    Task& task = *tasks_.emplace_back(new Task{latest_id_});
+    fair_queue_.Reserve(tasks_.size());
+    return task;
 }
 
-void TaskManager::SwitchTask(const TaskContext& current_ctx) {
-    TaskContext& task_ctx = task_manager->CurrentTask().Context();
-    memcpy(&task_ctx, &current_ctx, sizeof(TaskContext));
-    Task* current_task = RotateCurrentRunQueue(false);
-    if (&CurrentTask() != current_task) {
-        RestoreContext(&CurrentTask().Context());
+// 割り込みハンドラから呼ばれるので，割り込みは既に禁止されている
+void TaskManager::SwitchTask(const TaskContext& current_ctx,
+                             bool slice_expired) {
+    lock_.Lock();
+    if (current_task_->kill_pending_ && (current_ctx.cs & 3) == 3) {
+        // ユーザモードで止めたので，カーネル内のロックは何も保持していない
+        lock_.Unlock();
+        Finish(128 + SIGKILL);
+    }
+
+    Task* current_task =
+        slice_expired ? RotateCurrentRunQueue(false) : PreemptCurrent();
+    Task* next_task = current_task_;
+    lock_.Unlock();
+
+    // 切り替えないときは割り込みハンドラがスタックから復帰するので，コピーは不要
+    if (next_task != current_task) {
+        memcpy(&current_task->Context(), &current_ctx, sizeof(TaskContext));
+        RestoreContext(&next_task->Context());
     }
 }
 
 void TaskManager::Sleep(Task* task) {
+    const auto rflags = lock_.LockIRQSave();
     if (!task->Running()) {
+        lock_.UnlockIRQRestore(rflags);
         return;
     }
 
     task->SetRunning(false);
 
-    if (task == running_[current_level_].front()) {
+    if (task == current_task_) {
         Task* current_task = RotateCurrentRunQueue(true);
-        SwitchContext(&CurrentTask().Context(), &current_task->Context());
+        Task* next_task = current_task_;
+        lock_.Unlock();
+        SwitchContext(&next_task->Context(), &current_task->Context());
+        RestoreInterrupts(rflags);
         return;
     }
 
-    Erase(running_[task->Level()], task);
+    Dequeue(task);
+    Unboost(task);
+    lock_.UnlockIRQRestore(rflags);
 }
 
 Error TaskManager::Sleep(uint64_t id) {
-    auto it = std::find_if(tasks_.begin(), tasks_.end(),
-                           [id](const auto& t) { return t->ID() == id; });
-    if (it == tasks_.end()) {
+    Task* task;
+    {
+        ScopedIRQLock lock{lock_};
+        task = FindTask(id);
+    }
+    if (task == nullptr) {
         return MAKE_ERROR(Error::kNoSuchTask);
     }
 
-    Sleep(it->get());
+    Sleep(task);
     return MAKE_ERROR(Error::kSuccess);
 }
 
-void TaskManager::Wakeup(Task* task, int level) {
-    if (task->Running()) {
-        ChangeLevelRunning(task, level);
-        return;
-    }
+void WaitQueue::WakeOne() { task_manager->WakeOne(*this); }
+
+void WaitQueue::WakeAll() { task_manager->WakeAll(*this); }
+
+void TaskManager::SleepOn(WaitQueue& queue) {
+    lock_.Lock();
+    Task* task = current_task_;
+    task->wait_queue_ = &queue;
+    queue.waiters_.PushBack(task);
+    lock_.Unlock();
 
-    if (level < 0) {
-        level = task->Level();
+    Sleep(task);
+
+    // WakeOne/WakeAll以外で起こされたときは，まだ待ち行列に残っている
+    lock_.Lock();
+    if (task->wait_queue_) {
+        task->wait_queue_->waiters_.Erase(task);
+        task->wait_queue_ = nullptr;
     }
+    lock_.Unlock();
+}
 
-    task->SetLevel(level);
-    task->SetRunning(true);
+void TaskManager::WakeOne(WaitQueue& queue) {
+    {
+        ScopedIRQLock lock{lock_};
+        WakeQueueLocked(queue, 1, -1);
+    }
+    PreemptIfNeeded();
+}
 
-    running_[level].push_back(task);
-    if (level > current_level_) {
-        level_changed_ = true;
+void TaskManager::WakeAll(WaitQueue& queue) {
+    {
+        ScopedIRQLock lock{lock_};
+        WakeQueueLocked(queue, queue.waiters_.Size(), -1);
     }
+    PreemptIfNeeded();
+}
 
-    return;
+void TaskManager::Wakeup(Task* task, int level) {
+    {
+        ScopedIRQLock lock{lock_};
+        if (level >= 0) {
+            task->boosted_ = false;
+        }
+        WakeupLocked(task, level);
+    }
+    PreemptIfNeeded();
 }
 
 Error TaskManager::Wakeup(uint64_t id, int level) {
-    auto it = std::find_if(tasks_.begin(), tasks_.end(),
-                           [id](const auto& t) { return t->ID() == id; });
-    if (it == tasks_.end()) {
-        return MAKE_ERROR(Error::kNoSuchTask);
-    }
+    {
+        ScopedIRQLock lock{lock_};
+        Task* task = FindTask(id);
+        if (task == nullptr) {
+            return MAKE_ERROR(Error::kNoSuchTask);
+        }
 
-    Wakeup(it->get(), level);
+        if (level >= 0) {
+            task->boosted_ = false;
+        }
+        WakeupLocked(task, level);
+    }
+    PreemptIfNeeded();
     return MAKE_ERROR(Error::kSuccess);
 }
 
+// 割り込みハンドラからも呼ばれるので，ここではメモリを確保しない
+// 宛先を探して起こすためにlock_は取るが，lock_は割り込みを禁止して保持されるので，
+// シングルコアでは割り込みハンドラがここで待たされることはない
 Error TaskManager::SendMessage(uint64_t id, const Message& msg) {
-    auto it = std::find_if(tasks_.begin(), tasks_.end(),
-                           [id](const auto& t) { return t->ID() == id; });
-    if (it == tasks_.end()) {
-        return MAKE_ERROR(Error::kNoSuchTask);
+    bool pushed;
+    {
+        ScopedIRQLock lock{lock_};
+        Task* task = FindTask(id);
+        if (task == nullptr) {
+            return MAKE_ERROR(Error::kNoSuchTask);
+        }
+
+        // 捨てた場合も，溜まっているメッセージを処理させるために起こす
+        pushed = (msg.type == Message::kMouseMove &&
+                  task->msgs_.CoalesceMouseMove(msg)) ||
+                 task->PushMessage(msg);
+        if (IsInputMessage(msg.type)) {
+            Boost(task);
+        } else {
+            WakeQueueLocked(task->msgs_wait_,
+                            task->msgs_wait_.waiters_.Size(), -1);
+        }
     }
+    PreemptIfNeeded();
+    return MAKE_ERROR(pushed ? Error::kSuccess : Error::kFull);
+}
 
-    (*it)->SendMessage(msg);
-    return MAKE_ERROR(Error::kSuccess);
+Task& TaskManager::CurrentTask() {
+    ScopedIRQLock lock{lock_};
+    return *current_task_;
 }
 
-Task& TaskManager::CurrentTask() { return *running_[current_level_].front(); }
+bool TaskManager::ReschedulePending() {
+    ScopedIRQLock lock{lock_};
+    return resched_pending_;
+}
 
 void TaskManager::Finish(int exit_code) {
+    // 別のタスクへ切り替えるので，割り込み状態は戻さない
+    lock_.LockIRQSave();
     Task* current_task = RotateCurrentRunQueue(true);
 
-    const auto task_id = current_task->ID();
+    finish_tasks_[current_task->ID()] = exit_code;
+    WakeQueueLocked(current_task->finish_wait_,
+                    current_task->finish_wait_.waiters_.Size(), -1);
 
     auto it = std::find_if(
         tasks_.begin(), tasks_.end(),
         [current_task](const auto& t) { return t.get() == current_task; });
     tasks_.erase(it);
 
-    finish_tasks_[task_id] = exit_code;
-    if (auto it = finish_waiter_.find(task_id); it != finish_waiter_.end()) {
-        auto waiter = it->second;
-        finish_waiter_.erase(it);
-        Wakeup(waiter);
-    }
-
-    RestoreContext(&CurrentTask().Context());
+    Task* next_task = current_task_;
+    lock_.Unlock();
+    RestoreContext(&next_task->Context());
 }
 
 WithError<int> TaskManager::WaitFinish(uint64_t task_id) {
-    int exit_code;
-    Task* curret_task = &CurrentTask();
-
+    // 割り込み禁止のまま眠るので，Finishからの起床を取りこぼさない
+    InterruptGuard guard;
     while (true) {
+        lock_.Lock();
         if (auto it = finish_tasks_.find(task_id); it != finish_tasks_.end()) {
-            exit_code = it->second;
+            const int exit_code = it->second;
             finish_tasks_.erase(it);
-            break;
+            lock_.Unlock();
+            return {exit_code, MAKE_ERROR(Error::kSuccess)};
+        }
+
+        // 他に待っていたタスクが終了コードを受け取った
+        Task* task = FindTask(task_id);
+        lock_.Unlock();
+        if (task == nullptr) {
+            return {0, MAKE_ERROR(Error::kNoSuchTask)};
+        }
+
+        SleepOn(task->finish_wait_);
+    }
+}
+
+Error TaskManager::SetNice(uint64_t id, int nice) {
+    ScopedIRQLock lock{lock_};
+    Task* task = FindTask(id);
+    if (task == nullptr) {
+        return MAKE_ERROR(Error::kNoSuchTask);
+    }
+
+    // 重みは次に実行時間を加算するときから使われる
+    task->nice_ = std::clamp(nice, Task::kMinNice, Task::kMaxNice);
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+Error TaskManager::Kill(uint64_t id) {
+    {
+        ScopedIRQLock lock{lock_};
+        Task* task = FindTask(id);
+        if (task == nullptr) {
+            return MAKE_ERROR(Error::kNoSuchTask);
+        }
+
+        task->kill_pending_ = true;
+        WakeupLocked(task, -1);
+    }
+    PreemptIfNeeded();
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+Task* TaskManager::FindTask(uint64_t id) {
+    ASSERT_LOCK_HELD(lock_);
+    auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                           [id](const auto& t) { return t->ID() == id; });
+    if (it == tasks_.end()) {
+        return nullptr;
+    }
+    return it->get();
+}
+
+void TaskManager::WakeupLocked(Task* task, int level) {
+    ASSERT_LOCK_HELD(lock_);
+    if (task->Running()) {
+        ChangeLevelRunning(task, level);
+    } else {
+        if (level < 0) {
+            level = task->Level();
         }
 
-        finish_waiter_[task_id] = curret_task;
-        Sleep(curret_task);
+        task->SetLevel(level);
+        task->SetRunning(true);
+        Enqueue(task);
     }
 
-    return {exit_code, MAKE_ERROR(Error::kSuccess)};
+    if (task != current_task_ && task->Level() > current_task_->Level()) {
+        resched_pending_ = true;
+    }
+}
+
+void TaskManager::PreemptIfNeeded() {
+    const auto rflags = lock_.LockIRQSave();
+    // 割り込みハンドラの中やスピンロックの保持中は切り替えられない
+    // そのときは割り込みハンドラの最後か，次のタイマ割り込みで切り替わる
+    if (!resched_pending_ || (rflags & kRFlagsIF) == 0) {
+        lock_.UnlockIRQRestore(rflags);
+        return;
+    }
+
+    Task* current_task = PreemptCurrent();
+    Task* next_task = current_task_;
+    lock_.Unlock();
+    if (next_task != current_task) {
+        SwitchContext(&next_task->Context(), &current_task->Context());
+    }
+    RestoreInterrupts(rflags);
+}
+
+void TaskManager::WakeQueueLocked(WaitQueue& queue, size_t count, int level) {
+    ASSERT_LOCK_HELD(lock_);
+    for (; count > 0 && !queue.waiters_.Empty(); --count) {
+        Task* task = queue.waiters_.PopFront();
+        task->wait_queue_ = nullptr;
+        WakeupLocked(task, level);
+    }
 }
 
 void TaskManager::ChangeLevelRunning(Task* task, int level) {
@@ -228,49 +514,153 @@ void TaskManager::ChangeLevelRunning(Task* task, int level) {
         return;
     }
 
-    if (task != running_[current_level_].front()) {
-        Erase(running_[task->Level()], task);
-        running_[level].push_back(task);
-        task->SetLevel(level);
-        if (level > current_level_) {
-            level_changed_ = true;
-        }
-        return;
+    if (task == current_task_) {
+        // 元のレベルで実行した分を先に精算する
+        UpdateCurrentRuntime();
     }
 
-    running_[current_level_].pop_front();
-    running_[level].push_front(task);
+    Dequeue(task);
     task->SetLevel(level);
-    if (level >= current_level_) {
-        current_level_ = level;
+
+    if (task == current_task_ && level != kFairLevel) {
+        // 実行中のタスクは常にキューの先頭にいる
+        running_[level].PushFront(task);
+        return;
+    }
+
+    Enqueue(task);
+}
+
+// 入力を受け取ったタスクを，CPUを使い続けている公平クラスのタスクより先に実行する
+// 入力を送るメインタスクが眠った時点で，タイムスライスを待たずに切り替わる
+void TaskManager::Boost(Task* task) {
+    // メッセージ以外を待って眠っているタスクは起こさない
+    if (!task->Running() && task->wait_queue_ != &task->msgs_wait_) {
+        return;
+    }
+
+    int level = -1;
+    if (task->boosted_ || task->Level() < kBoostLevel) {
+        if (!task->boosted_) {
+            task->boosted_ = true;
+            task->base_level_ = task->Level();
+        }
+        task->boost_expire_ = timer_manager->CurrentTick() + kBoostPeriod;
+        level = kBoostLevel;
+    }
+
+    if (task->Running()) {
+        WakeupLocked(task, level);
     } else {
-        current_level_ = level;
-        level_changed_ = true;
+        WakeQueueLocked(task->msgs_wait_, task->msgs_wait_.waiters_.Size(),
+                        level);
     }
 }
 
-Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
-    auto& level_queue = running_[current_level_];
-    Task* current_task = level_queue.front();
-    level_queue.pop_front();
-    if (!current_sleep) {
-        level_queue.push_back(current_task);
+// キューから外したタスクを元のレベルへ戻す
+void TaskManager::Unboost(Task* task) {
+    if (task->boosted_) {
+        task->boosted_ = false;
+        task->SetLevel(task->base_level_);
+    }
+}
+
+void TaskManager::Enqueue(Task* task) {
+    if (task->Level() != kFairLevel) {
+        running_[task->Level()].PushBack(task);
+        return;
     }
 
-    if (level_queue.empty()) {
-        level_changed_ = true;
+    // 長く眠っていたタスクが溜め込んだ分だけCPUを独占しないよう，
+    // 他のタスクのvruntimeの近くまで進めてからキューに入れる
+    const uint64_t credit = SleeperCredit();
+    if (min_vruntime_ > credit) {
+        task->vruntime_ = std::max(task->vruntime_, min_vruntime_ - credit);
     }
+    fair_queue_.Push(task);
+}
+
+void TaskManager::Dequeue(Task* task) {
+    if (task->Level() == kFairLevel) {
+        fair_queue_.Erase(task);
+    } else {
+        running_[task->Level()].Erase(task);
+    }
+}
 
-    if (level_changed_) {
-        level_changed_ = false;
-        for (int lv = kMaxLevel; lv >= 0; lv--) {
-            if (!running_[lv].empty()) {
-                current_level_ = lv;
-                break;
+void TaskManager::UpdateCurrentRuntime() {
+    const uint64_t now = LAPICTimerCount();
+    const uint64_t delta = now - current_task_->exec_start_;
+    current_task_->exec_start_ = now;
+
+    // 引き上げられている間の実行時間も元のクラスで精算する
+    const bool fair = current_task_->boosted_
+                          ? current_task_->base_level_ == kFairLevel
+                          : current_task_->Level() == kFairLevel;
+    if (fair) {
+        current_task_->vruntime_ +=
+            delta * kNice0Weight / NiceToWeight(current_task_->nice_);
+    }
+}
+
+Task* TaskManager::PickNextTask() {
+    for (int lv = kMaxLevel; lv >= 0; --lv) {
+        if (lv == kFairLevel) {
+            if (!fair_queue_.Empty()) {
+                return fair_queue_.Top();
             }
+        } else if (!running_[lv].Empty()) {
+            return running_[lv].Front();
         }
     }
 
+    // アイドルタスクは眠らないのでここには来ない
+    return current_task_;
+}
+
+Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
+    ASSERT_LOCK_HELD(lock_);
+    Task* current_task = current_task_;
+    UpdateCurrentRuntime();
+
+    if (current_sleep) {
+        Dequeue(current_task);
+        Unboost(current_task);
+    } else if (current_task->boosted_ &&
+               timer_manager->CurrentTick() >= current_task->boost_expire_) {
+        Dequeue(current_task);
+        Unboost(current_task);
+        Enqueue(current_task);
+    } else if (current_task->Level() == kFairLevel) {
+        fair_queue_.Update(current_task);
+    } else {
+        auto& level_queue = running_[current_task->Level()];
+        level_queue.Erase(current_task);
+        level_queue.PushBack(current_task);
+    }
+
+    if (!fair_queue_.Empty()) {
+        min_vruntime_ = std::max(min_vruntime_, fair_queue_.Top()->vruntime_);
+    }
+
+    current_task_ = PickNextTask();
+    current_task_->exec_start_ = LAPICTimerCount();
+    resched_pending_ = false;
+    return current_task;
+}
+
+// 実行中のタスクをレベル内の順番を変えずに残し，高いレベルのタスクへ切り替える
+Task* TaskManager::PreemptCurrent() {
+    ASSERT_LOCK_HELD(lock_);
+    Task* current_task = current_task_;
+    UpdateCurrentRuntime();
+    if (current_task->Level() == kFairLevel) {
+        fair_queue_.Update(current_task);
+    }
+
+    current_task_ = PickNextTask();
+    current_task_->exec_start_ = LAPICTimerCount();
+    resched_pending_ = false;
     return current_task;
 }
 
@@ -279,10 +669,8 @@ TaskManager* task_manager;
 void InitializeTask() {
     task_manager = new TaskManager;
 
-    __asm__("cli");
     timer_manager->AddTimer(Timer{
         timer_manager->CurrentTick() + kTaskTimerPeriod, kTaskTimerValue, 1});
-    __asm__("sti");
 }
 
 __attribute__((no_caller_saved_registers)) extern "C" uint64_t
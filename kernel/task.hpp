@@ -10,16 +10,22 @@
 
 #include "error.hpp"
 #include "fat.hpp"
+#include "fpu.hpp"
+#include "lock.hpp"
 #include "message.hpp"
+#include "message_queue.hpp"
+#include "shared_memory.hpp"
 #include "task.hpp"
 
-struct TaskContext {
+// fpu_areaはxsaveのために64バイト境界に置く
+struct alignas(64) TaskContext {
     uint64_t cr3, rip, rflags, reserved1;
     uint64_t cs, ss, fs, gs;
     uint64_t rax, rbx, rcx, rdx, rdi, rsi, rsp, rbp;
     uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
-    std::array<uint8_t, 512> fxsave_area;
+    std::array<uint8_t, kFPUAreaSize> fpu_area;
 } __attribute__((packed));
+static_assert(offsetof(TaskContext, fpu_area) == 0xc0);
 
 using TaskFunc = void(uint64_t, int64_t);
 
@@ -28,10 +34,104 @@ struct FileMapping {
     uint64_t vaddr_begin, vaddr_end;
 };
 
+// アドレス空間とファイルディスクリプタ表を共有するスレッドの集まり
+class Process {
+   public:
+    uint64_t CR3() const { return cr3_; }
+    void SetCR3(uint64_t cr3) { cr3_ = cr3; }
+    std::vector<std::shared_ptr<::FileDescriptor>>& Files() { return files_; }
+    uint64_t DPagingBegin() const { return dpaging_begin_; }
+    void SetDPagingBegin(uint64_t v) { dpaging_begin_ = v; }
+    uint64_t DPagingEnd() const { return dpaging_end_; }
+    void SetDPagingEnd(uint64_t v) { dpaging_end_ = v; }
+    uint64_t FileMapEnd() const { return file_map_end_; }
+    void SetFileMapEnd(uint64_t v) { file_map_end_ = v; }
+    std::vector<FileMapping>& FileMaps() { return file_maps_; }
+    std::vector<SharedMapping>& SharedMaps() { return shared_maps_; }
+    // 最初のタスク以外のスレッドのID
+    std::vector<uint64_t>& Threads() { return threads_; }
+
+    // 複数のスレッドから変更するときに保持する
+    // ページフォールトの処理からも参照されるので，割り込みを禁止して取得する
+    SpinLock& Lock() { return lock_; }
+
+   private:
+    SpinLock lock_;
+    uint64_t cr3_{0};
+    std::vector<std::shared_ptr<::FileDescriptor>> files_{};
+    uint64_t dpaging_begin_{0}, dpaging_end_{0};
+    uint64_t file_map_end_{0};
+    std::vector<FileMapping> file_maps_{};
+    std::vector<SharedMapping> shared_maps_{};
+    std::vector<uint64_t> threads_{};
+};
+
+class Task;
+
+// Taskは実行待ちの列と待ち行列に同時に入ることがあるので，列の種類ごとにリンクを持つ
+enum TaskLinkKind { kRunLink, kWaitLink, kNumTaskLinks };
+
+struct TaskLink {
+    Task* prev{nullptr};
+    Task* next{nullptr};
+    // 入っている列．どこにも入っていなければnullptr
+    const void* list{nullptr};
+};
+
+// Taskに埋め込んだリンクでつなぐ双方向リスト
+// 出し入れでメモリを確保しないので，割り込みハンドラの中からも操作できる
+template <TaskLinkKind kLink>
+class TaskList {
+   public:
+    TaskList() = default;
+    TaskList(const TaskList&) = delete;
+    TaskList& operator=(const TaskList&) = delete;
+
+    bool Empty() const { return head_ == nullptr; }
+    size_t Size() const { return size_; }
+    Task* Front() const { return head_; }
+    void PushFront(Task* task);
+    void PushBack(Task* task);
+    Task* PopFront();
+    // taskがこの列に入っていなければ何もしない
+    void Erase(Task* task);
+
+   private:
+    Task* head_{nullptr};
+    Task* tail_{nullptr};
+    size_t size_{0};
+};
+
+// 条件が成り立つのを待つタスクの待ち行列
+// 条件を変えた側だけがWakeOne/WakeAllで起こすので，無関係な出来事では起こされない
+class WaitQueue {
+   public:
+    WaitQueue() = default;
+    WaitQueue(const WaitQueue&) = delete;
+    WaitQueue& operator=(const WaitQueue&) = delete;
+
+    // condがtrueを返すまで眠る
+    // condは割り込みを禁止した状態で評価されるので，評価から眠るまでに起床を取りこぼさない
+    template <class Cond>
+    void WaitUntil(Cond cond);
+    void WakeOne();
+    void WakeAll();
+
+   private:
+    // task_managerのロックで保護する
+    TaskList<kWaitLink> waiters_{};
+
+    friend class TaskManager;
+};
+
+// メッセージを選んで受け取るときに使う．trueを返したメッセージだけを受け取る
+using MessageFilter = bool(const Message&);
+
 class Task {
    public:
     static const int kDefaultLevel = 1;
     static const size_t kDefaultStackBytes = 8 * 4096;
+    static const int kMinNice = -20, kMaxNice = 19;
 
     Task(uint64_t id);
     Task& InitContext(TaskFunc* f, int64_t data);
@@ -42,7 +142,12 @@ class Task {
     Task& Wakeup();
 
     void SendMessage(const Message& msg);
-    std::optional<Message> ReceiveMessage();
+    // filterを指定すると，合わないメッセージはキューに残したまま読み飛ばす
+    std::optional<Message> ReceiveMessage(MessageFilter* filter = nullptr);
+    // メッセージが届くまで眠ってから受け取る．終了を要求されたらnulloptを返す
+    std::optional<Message> WaitMessage(MessageFilter* filter = nullptr);
+    // キューが満杯で捨てられたメッセージの数
+    uint64_t DroppedMessages() const { return msgs_.Dropped(); }
     std::vector<std::shared_ptr<::FileDescriptor>>& Files();
     uint64_t DPagingBegin() const;
     void SetDPagingBegin(uint64_t v);
@@ -52,21 +157,45 @@ class Task {
     void SetFileMapEnd(uint64_t v);
     std::vector<FileMapping>& FileMaps();
 
+    Process& GetProcess() { return *process_; }
+    // ownerと同じプロセスのスレッドにする
+    Task& ShareProcess(Task& owner);
+    bool KillPending() const { return kill_pending_; }
+
     int Level() const { return level_; }
     bool Running() const { return running_; }
+    int Nice() const { return nice_; }
+    uint64_t VRuntime() const { return vruntime_; }
 
    private:
     uint64_t id_;
     std::vector<uint64_t> stack_;
-    alignas(16) TaskContext context_;
+    TaskContext context_;
     uint64_t os_stack_ptr_;
-    std::deque<Message> msgs_;
+    MessageQueue msgs_;
+    // filterで読み飛ばしたメッセージ．このタスクだけが触る
+    std::deque<Message> deferred_msgs_;
+    WaitQueue msgs_wait_;
+    // このタスクの終了を待つタスク
+    WaitQueue finish_wait_;
+    // 眠っている間に入っている待ち行列．WakeOne/WakeAllで起こされるとnullptr
+    WaitQueue* wait_queue_{nullptr};
     unsigned int level_{kDefaultLevel};
     bool running_{false};
-    std::vector<std::shared_ptr<::FileDescriptor>> files_{};
-    uint64_t dpaging_begin_{0}, dpaging_end_{0};
-    u_int64_t file_map_end_{0};
-    std::vector<FileMapping> file_maps_{};
+    std::shared_ptr<Process> process_;
+    // trueになったスレッドは次にユーザモードで止まったときに終了する
+    bool kill_pending_{false};
+
+    // 公平スケジューリング用 vruntimeはnice値で重み付けしたLAPICタイマのカウント
+    int nice_{0};
+    uint64_t vruntime_{0};
+    uint64_t exec_start_{0};
+    size_t fair_index_{0};
+
+    // 入力を受け取って一時的にレベルを引き上げられている間はtrue
+    bool boosted_{false};
+    unsigned int base_level_{kDefaultLevel};
+    unsigned long boost_expire_{0};
 
     Task& SetLevel(unsigned int level) {
         level_ = level;
@@ -78,16 +207,55 @@ class Task {
         return *this;
     }
 
+    std::array<TaskLink, kNumTaskLinks> links_{};
+
+    bool PushMessage(const Message& msg);
+
     friend class TaskManager;
+    friend class FairRunQueue;
+    template <TaskLinkKind>
+    friend class TaskList;
+};
+
+// vruntimeが最小のタスクを取り出す二分ヒープ
+// 各タスクが自分の位置を覚えているので，任意のタスクの削除や更新もO(log n)
+class FairRunQueue {
+   public:
+    FairRunQueue();
+    bool Empty() const { return heap_.empty(); }
+    Task* Top() const { return heap_.front(); }
+    // 割り込みハンドラの中でPushしても確保が起きないよう，タスクの数だけ先に確保する
+    void Reserve(size_t n) { heap_.reserve(n); }
+    void Push(Task* task);
+    void Erase(Task* task);
+    // 実行によってvruntimeが増えたタスクの位置を直す
+    void Update(Task* task);
+
+   private:
+    std::vector<Task*> heap_;
+
+    bool Less(size_t a, size_t b) const;
+    void Swap(size_t a, size_t b);
+    void SiftUp(size_t i);
+    void SiftDown(size_t i);
 };
 
 class TaskManager {
    public:
     static const int kMaxLevel = 3;
+    // このレベルのタスクは重み付きの公平スケジューリングで選ぶ
+    // 他のレベルはこれまで通り高いレベルから厳密に優先する
+    static const int kFairLevel = Task::kDefaultLevel;
+    // キーやマウスのメッセージを受け取ったタスクを一時的に置くレベル
+    static const int kBoostLevel = 2;
 
     TaskManager();
     Task& NewTask();
-    void SwitchTask(const TaskContext& current_ctx);
+    // 割り込みハンドラから呼ぶ．slice_expiredがfalseなら，高いレベルのタスクへ
+    // 切り替えるだけで，実行中のタスクの順番は変えない
+    void SwitchTask(const TaskContext& current_ctx, bool slice_expired = true);
+    // 実行中のタスクより高いレベルのタスクが起きていればtrue
+    bool ReschedulePending();
 
     void Sleep(Task* task);
     Error Sleep(uint64_t id);
@@ -98,20 +266,113 @@ class TaskManager {
     Task& CurrentTask();
     void Finish(int exit_code);
     WithError<int> WaitFinish(uint64_t task_id);
+    Error SetNice(uint64_t id, int nice);
+    // タスクに終了を要求する．眠っていれば起こす
+    Error Kill(uint64_t id);
+
+    // 現在のタスクをqueueに入れて眠る．割り込みを禁止した状態で呼ぶ
+    void SleepOn(WaitQueue& queue);
+    void WakeOne(WaitQueue& queue);
+    void WakeAll(WaitQueue& queue);
 
    private:
+    // 割り込みハンドラからも操作されるので，取得中は割り込みを禁止する
+    SpinLock lock_;
     std::vector<std::unique_ptr<Task>> tasks_{};
     uint64_t latest_id_{0};
-    std::array<std::deque<Task*>, kMaxLevel + 1> running_{};
-    int current_level_{kMaxLevel};
-    bool level_changed_{false};
+    // kFairLevelのタスクはrunning_ではなくfair_queue_に入る
+    std::array<TaskList<kRunLink>, kMaxLevel + 1> running_{};
+    FairRunQueue fair_queue_{};
+    uint64_t min_vruntime_{0};
+    Task* current_task_{nullptr};
     std::map<uint64_t, int> finish_tasks_{};
-    std::map<uint64_t, Task*> finish_waiter_{};
+    // 実行中のタスクより高いレベルのタスクを起こしたらtrue．次にタスクを選ぶと戻る
+    bool resched_pending_{false};
 
+    Task* FindTask(uint64_t id);
+    void WakeupLocked(Task* task, int level);
+    // 起きたタスクが実行中のタスクより高いレベルなら，割り込みが許可されていれば切り替える
+    void PreemptIfNeeded();
+    Task* PreemptCurrent();
+    void WakeQueueLocked(WaitQueue& queue, size_t count, int level);
     void ChangeLevelRunning(Task* task, int level);
+    void Boost(Task* task);
+    void Unboost(Task* task);
+    void Enqueue(Task* task);
+    void Dequeue(Task* task);
+    void UpdateCurrentRuntime();
+    Task* PickNextTask();
     Task* RotateCurrentRunQueue(bool current_sleep);
 };
 
 extern TaskManager* task_manager;
 
+template <TaskLinkKind kLink>
+void TaskList<kLink>::PushFront(Task* task) {
+    auto& link = task->links_[kLink];
+    link.prev = nullptr;
+    link.next = head_;
+    link.list = this;
+    if (head_) {
+        head_->links_[kLink].prev = task;
+    } else {
+        tail_ = task;
+    }
+    head_ = task;
+    ++size_;
+}
+
+template <TaskLinkKind kLink>
+void TaskList<kLink>::PushBack(Task* task) {
+    auto& link = task->links_[kLink];
+    link.prev = tail_;
+    link.next = nullptr;
+    link.list = this;
+    if (tail_) {
+        tail_->links_[kLink].next = task;
+    } else {
+        head_ = task;
+    }
+    tail_ = task;
+    ++size_;
+}
+
+template <TaskLinkKind kLink>
+Task* TaskList<kLink>::PopFront() {
+    Task* task = head_;
+    if (task) {
+        Erase(task);
+    }
+    return task;
+}
+
+template <TaskLinkKind kLink>
+void TaskList<kLink>::Erase(Task* task) {
+    auto& link = task->links_[kLink];
+    if (link.list != this) {
+        return;
+    }
+
+    if (link.prev) {
+        link.prev->links_[kLink].next = link.next;
+    } else {
+        head_ = link.next;
+    }
+    if (link.next) {
+        link.next->links_[kLink].prev = link.prev;
+    } else {
+        tail_ = link.prev;
+    }
+    link = TaskLink{};
+    --size_;
+}
+
+template <class Cond>
+void WaitQueue::WaitUntil(Cond cond) {
+    InterruptGuard guard;
+    while (!cond()) {
+        task_manager->SleepOn(*this);
+    }
+}
+
 void InitializeTask();
\ No newline at end of file
@@ -1,21 +1,27 @@
 #include "terminal.hpp"
 
+#include <cstdlib>
 #include <cstring>
 #include <limits>
 
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "console.hpp"
 #include "elf.hpp"
 #include "fat.hpp"
 #include "font.hpp"
 #include "keyboard.hpp"
+#include "latency.hpp"
 #include "layer.hpp"
+#include "logger.hpp"
 #include "memory_manager.hpp"
 #include "paging.hpp"
 #include "pci.hpp"
 #include "timer.hpp"
 
 namespace {
+const int kBlinkTimerValue = 1;
+
 WithError<int> MakeArgVector(char* command, char* first_arg, char** argv,
                              int argv_len, char* argbuf, int argbuf_len) {
     int argc = 0;
@@ -147,12 +153,14 @@ WithError<PageMapEntry*> SetupPML4(Task& current_task) {
     SetCR3(cr3);
 
     current_task.Context().cr3 = cr3;
+    current_task.GetProcess().SetCR3(cr3);
     return pml4;
 }
 
 Error FreePML4(Task& current_task) {
     const auto cr3 = current_task.Context().cr3;
     current_task.Context().cr3 = 0;
+    current_task.GetProcess().SetCR3(0);
 
     // OS用のPML4に戻す
     ResetCR3();
@@ -161,6 +169,28 @@ Error FreePML4(Task& current_task) {
     return memory_manager->Free(frame, 1);
 }
 
+// メインスレッドが終了したら，アドレス空間を解放する前に他のスレッドを止める
+void TerminateThreads(Task& task) {
+    // 止める前のスレッドが新しく作ったスレッドも止める
+    while (true) {
+        std::vector<uint64_t> threads;
+        {
+            ScopedIRQLock lock{task.GetProcess().Lock()};
+            threads.swap(task.GetProcess().Threads());
+        }
+        if (threads.empty()) {
+            return;
+        }
+
+        for (auto id : threads) {
+            task_manager->Kill(id);
+        }
+        for (auto id : threads) {
+            task_manager->WaitFinish(id);
+        }
+    }
+}
+
 // ルートディレクトリのエントリを列挙
 void ListAllEntries(FileDescriptor& fd, uint32_t dir_cluster) {
     const auto kEntriesPerCluster =
@@ -282,10 +312,13 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
 
         DrawTerminal(*window_->InnerDrawer(), {0, 0}, window_->InnerSize());
 
-        layer_id_ = layer_manager->NewLayer()
-                        .SetWindow(window_)
-                        .SetDraggable(true)
-                        .ID();
+        {
+            ScopedLock lock{layer_mutex};
+            layer_id_ = layer_manager->NewLayer()
+                            .SetWindow(window_)
+                            .SetDraggable(true)
+                            .ID();
+        }
 
         Print(">");
     }
@@ -319,6 +352,8 @@ Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
                                   char ascii) {
     DrawCursor(false);
 
+    const int row_before = cursor_pos_.y;
+    const int scrolled_before = scrolled_rows_;
     Rectangle<int> draw_area{CalcCursorPos(),
                              {kFontHorizonPixels * 2, kFontVerticalPixels}};
 
@@ -342,8 +377,8 @@ Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
 
         ExecuteLine();
         Print(">");
-        draw_area.pos = ToplevelWindow::kTopLeftMargin;
-        draw_area.size = window_->InnerSize();
+        // 出力した行はPrintが，ずれた行はScroll1が描かせている
+        draw_area = RowsSince(row_before, scrolled_before);
     } else if (ascii == '\b') {
         if (cursor_pos_.x > 0) {
             --cursor_pos_.x;
@@ -383,9 +418,7 @@ Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
 
 WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry,
                                      char* command, char* first_arg) {
-    __asm__("cli");
     auto& task = task_manager->CurrentTask();
-    __asm__("sti");
 
     auto [app_load, err] = LoadApp(file_entry, task);
     if (err) {
@@ -430,11 +463,17 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry,
                       stack_frame_addr.value + stack_size - 8,
                       &task.OSStackPointer());
 
+    TerminateThreads(task);
+
     task.Files().clear();
     task.FileMaps().clear();
 
-    if (auto err = CleanPageMaps(LinearAddress4Level{0xffff'8000'0000'0000})) {
-        return {0, err};
+    const auto clean_err =
+        CleanPageMaps(LinearAddress4Level{0xffff'8000'0000'0000});
+    // ページテーブルから外してから共有メモリの参照を手放す
+    task.GetProcess().SharedMaps().clear();
+    if (clean_err) {
+        return {0, clean_err};
     }
 
     return {ret, FreePML4(task)};
@@ -474,7 +513,8 @@ void Terminal::Print(char32_t c) {
 }
 
 void Terminal::Print(const char* s, std::optional<size_t> len) {
-    const auto cursor_before = CalcCursorPos();
+    const int row_before = cursor_pos_.y;
+    const int scrolled_before = scrolled_rows_;
     DrawCursor(false);
 
     size_t i = 0;
@@ -487,19 +527,8 @@ void Terminal::Print(const char* s, std::optional<size_t> len) {
     }
 
     DrawCursor(true);
-    const auto cursor_after = CalcCursorPos();
-
-    Vector2D<int> draw_pos{ToplevelWindow::kTopLeftMargin.x, cursor_before.y};
-    Vector2D<int> draw_size{
-        window_->InnerSize().x,
-        cursor_after.y - cursor_before.y + kFontVerticalPixels};
-
-    Rectangle<int> draw_area{draw_pos, draw_size};
-    Message msg = MakeLayerMessage(task_.ID(), LayerID(),
-                                   LayerOperation::DrawArea, draw_area);
-    __asm__("cli");
-    task_manager->SendMessage(1, msg);
-    __asm__("sti");
+
+    RequestDraw(RowsSince(row_before, scrolled_before));
 }
 
 void Terminal::ExecuteLine() {
@@ -546,28 +575,56 @@ void Terminal::ExecuteLine() {
     }
 
     std::shared_ptr<PipeDescriptor> pipe_fd;
-    uint64_t subtask_id = 0;
+    // 2段目以降のタスク．最後の要素が最終段
+    std::vector<uint64_t> stage_ids;
 
     if (pipe_char) {
+        // a | b | c を段ごとに分け，2段目以降はそれぞれ別のタスクで並行に動かす
+        // 1段目はキー入力とウィンドウを持つこのタスクで動かす
         *pipe_char = 0;
-        char* sub_command = &pipe_char[1];
-        while (isspace(*sub_command)) {
-            ++sub_command;
+        std::vector<char*> stages;
+        for (char* stage = &pipe_char[1]; stage;) {
+            char* next = strchr(stage, '|');
+            if (next) {
+                *next++ = 0;
+            }
+            while (isspace(*stage)) {
+                ++stage;
+            }
+            stages.push_back(stage);
+            stage = next;
         }
 
-        auto& sub_task = task_manager->NewTask();
-        pipe_fd = std::make_shared<PipeDescriptor>(sub_task);
-        auto terminal_d = new TerminalDescriptor{
-            sub_command, true, false, {pipe_fd, files_[1], files_[2]}};
-        files_[1] = pipe_fd;
+        // リダイレクトは最終段の出力に効く
+        auto last_stdout = files_[1];
+        auto pipe = std::make_shared<Pipe>();
+        pipe_fd = std::make_shared<PipeDescriptor>(pipe,
+                                                   PipeDescriptor::kWriteEnd);
+        for (size_t i = 0; i < stages.size(); ++i) {
+            auto read_fd =
+                std::make_shared<PipeDescriptor>(pipe, PipeDescriptor::kReadEnd);
+            std::shared_ptr<FileDescriptor> write_fd = last_stdout;
+            if (i + 1 < stages.size()) {
+                pipe = std::make_shared<Pipe>();
+                write_fd = std::make_shared<PipeDescriptor>(
+                    pipe, PipeDescriptor::kWriteEnd);
+            }
 
-        subtask_id = sub_task
-                         .InitContext(TaskTerminal,
-                                      reinterpret_cast<int64_t>(terminal_d))
-                         .Wakeup()
-                         .ID();
+            // 各段の端は段のタスクだけが持つので，段が終わればEOFが次の段へ伝わる
+            auto terminal_d = new TerminalDescriptor{
+                stages[i], true, false, {read_fd, write_fd, files_[2]}};
+            stage_ids.push_back(
+                task_manager->NewTask()
+                    .InitContext(TaskTerminal,
+                                 reinterpret_cast<int64_t>(terminal_d))
+                    .Wakeup()
+                    .ID());
+        }
+        files_[1] = pipe_fd;
 
-        (*layer_task_map)[layer_id_] = subtask_id;
+        // キー入力は最終段が受け取る (moreなど)
+        ScopedLock lock{layer_mutex};
+        (*layer_task_map)[layer_id_] = stage_ids.back();
     }
 
     if (strcmp(command, "echo") == 0) {
@@ -641,17 +698,23 @@ void Terminal::ExecuteLine() {
             }
         }
 
-        if (fd) {
+        if (fd == files_[0]) {
+            // 端末からの入力は行ごとに表示する
             char u8buf[1024];
             DrawCursor(false);
             while (true) {
-                if (ReadDelim(*fd, '\n', u8buf, sizeof(u8buf)) == 0) {
+                const size_t n = ReadDelim(*fd, '\n', u8buf, sizeof(u8buf) - 1);
+                if (n == 0) {
                     break;
                 }
 
-                PrintToFD(*files_[1], "%s", u8buf);
+                files_[1]->Write(u8buf, n);
             }
 
+            DrawCursor(true);
+        } else if (fd) {
+            DrawCursor(false);
+            SpliceFD(*files_[1], *fd);
             DrawCursor(true);
         }
     } else if (strcmp(command, "noterm") == 0) {
@@ -660,6 +723,35 @@ void Terminal::ExecuteLine() {
         task_manager->NewTask()
             .InitContext(TaskTerminal, reinterpret_cast<int64_t>(term_desc))
             .Wakeup();
+    } else if (strcmp(command, "nice") == 0) {
+        // このターミナルから起動するアプリにも同じnice値が使われる
+        if (!first_arg || first_arg[0] == '\0') {
+            PrintToFD(*files_[1], "%d\n", task_.Nice());
+        } else {
+            char* end;
+            const long nice = strtol(first_arg, &end, 10);
+            if (*end != '\0') {
+                PrintToFD(*files_[2], "invalid nice value: %s\n", first_arg);
+                exit_code = 1;
+            } else {
+                task_manager->SetNice(
+                    task_.ID(),
+                    std::clamp<long>(nice, Task::kMinNice, Task::kMaxNice));
+                PrintToFD(*files_[1], "nice: %d\n", task_.Nice());
+            }
+        }
+    } else if (strcmp(command, "latency") == 0) {
+        if (first_arg && strcmp(first_arg, "reset") == 0) {
+            ResetKeyLatencyStat();
+        } else {
+            const auto stat = KeyLatencyStat();
+            PrintToFD(*files_[1], "key to screen: %lu samples\n", stat.count);
+            if (stat.count > 0) {
+                PrintToFD(*files_[1], "last %lu us, avg %lu us, max %lu us\n",
+                          stat.last_us, stat.total_us / stat.count,
+                          stat.max_us);
+            }
+        }
     } else if (strcmp(command, "memstat") == 0) {
         const auto stat = memory_manager->Stat();
 
@@ -687,14 +779,19 @@ void Terminal::ExecuteLine() {
 
     if (pipe_fd) {
         pipe_fd->FinishWrite();
-        __asm__("cli");
-        auto [error_code, err] = task_manager->WaitFinish(subtask_id);
-        (*layer_task_map)[layer_id_] = task_.ID();
-        __asm__("sti");
 
-        if (err) {
-            printk("failed to wait finish: %s\n", err.Name());
+        // パイプライン全体の終了コードは最終段のもの
+        for (uint64_t id : stage_ids) {
+            auto [stage_exit_code, err] = task_manager->WaitFinish(id);
+            if (err) {
+                printk("failed to wait finish: %s\n", err.Name());
+            } else if (id == stage_ids.back()) {
+                exit_code = stage_exit_code;
+            }
         }
+
+        ScopedLock lock{layer_mutex};
+        (*layer_task_map)[layer_id_] = task_.ID();
     }
 
     files_[1] = original_stdout;
@@ -702,28 +799,51 @@ void Terminal::ExecuteLine() {
 }
 
 void Terminal::Scroll1() {
-    Rectangle<int> move_src{
-        ToplevelWindow::kTopLeftMargin +
-            Vector2D<int>{4, 4 + kFontVerticalPixels},
-        {kColumns * kFontHorizonPixels, (kRows - 1) * kFontVerticalPixels}};
+    const Rectangle<int> text_area{
+        ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4},
+        {kColumns * kFontHorizonPixels, kRows * kFontVerticalPixels}};
 
-    window_->Move(ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4},
-                  move_src);
+    if (show_window_) {
+        // 画素をずらすのと，画面に写っている画素をずらす記録を同じロックの中で行う
+        // 間に合成されると，ずらした画素をもう一度ずらしてしまう
+        ScopedLock lock{layer_mutex};
+        layer_manager->Scroll(layer_id_, text_area, -kFontVerticalPixels);
+    } else {
+        Rectangle<int> move_src{
+            text_area.pos + Vector2D<int>{0, kFontVerticalPixels},
+            {text_area.size.x, text_area.size.y - kFontVerticalPixels}};
+        window_->Move(text_area.pos, move_src);
+    }
 
+    // 新しく現れた行は，この後のPrintやInputKeyが描き直させる
     FillRectangle(
         *window_->InnerDrawer(), {4, 4 + kFontVerticalPixels * cursor_pos_.y},
         {kFontHorizonPixels * kColumns, kFontVerticalPixels}, {0, 0, 0});
+    ++scrolled_rows_;
+}
+
+Rectangle<int> Terminal::RowsSince(int row, int scrolled_before) const {
+    // その後にスクロールした分だけ，row行目の内容は上へずれている
+    const int top = std::max(row - (scrolled_rows_ - scrolled_before), 0);
+    return {{ToplevelWindow::kTopLeftMargin.x,
+             ToplevelWindow::kTopLeftMargin.y + 4 + kFontVerticalPixels * top},
+            {window_->InnerSize().x,
+             kFontVerticalPixels * (cursor_pos_.y - top + 1)}};
 }
 
 void Terminal::Redraw() {
-    Rectangle<int> draw_area{ToplevelWindow::kTopLeftMargin,
-                             window_->InnerSize()};
-
-    Message msg = MakeLayerMessage(task_.ID(), LayerID(),
-                                   LayerOperation::DrawArea, draw_area);
-    __asm__("cli");
-    task_manager->SendMessage(1, msg);
-    __asm__("sti");
+    RequestDraw({ToplevelWindow::kTopLeftMargin, window_->InnerSize()});
+}
+
+void Terminal::RequestDraw(const Rectangle<int>& area) {
+    if (!show_window_) {
+        return;
+    }
+
+    // Scroll1と同じくロックの中で直接記録し，スクロールとの前後が入れ替わらないようにする
+    ScopedLock lock{layer_mutex};
+    layer_manager->AddDamage(layer_id_, area);
+    RequestCompose(task_.ID());
 }
 
 Rectangle<int> Terminal::HistoryUpDown(int direction) {
@@ -761,17 +881,16 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
         show_window = term_desc->show_window;
     }
 
-    __asm__("cli");
     Task& task = task_manager->CurrentTask();
     Terminal* terminal = new Terminal{task, term_desc};
 
     if (show_window) {
+        ScopedLock lock{layer_mutex};
         layer_manager->Move(terminal->LayerID(), {100, 200});
         active_layer->Activate(terminal->LayerID());
 
         layer_task_map->insert(std::make_pair(terminal->LayerID(), task_id));
     }
-    __asm__("sti");
 
     if (term_desc && !term_desc->command_line.empty()) {
         for (int i = 0; i < term_desc->command_line.length(); i++) {
@@ -781,15 +900,25 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
     }
 
     if (term_desc && term_desc->exit_after_command) {
+        const int exit_code = terminal->LastExitCode();
+        // パイプの読み出し側を閉じて，書き込み側が眠ったままにならないようにする
+        delete terminal;
         delete term_desc;
-        __asm__("cli");
-        task_manager->Finish(terminal->LastExitCode());
-        __asm__("sti");
+        task_manager->Finish(exit_code);
     }
 
-    auto add_blink_timer = [task_id](unsigned long t) {
-        timer_manager->AddTimer(
-            Timer{t + static_cast<int>(kTimerFreq * 0.5), 1, task_id});
+    TimerID blink_timer = kInvalidTimerID;
+    bool blink_timer_failed = false;
+    auto add_blink_timer = [task_id, &blink_timer,
+                            &blink_timer_failed](unsigned long t) {
+        blink_timer = timer_manager->AddTimer(Timer{
+            t + static_cast<int>(kTimerFreq * 0.5), kBlinkTimerValue, task_id});
+        // タイマが足りないときは一度だけ警告し，次のメッセージで登録し直す
+        if (blink_timer == kInvalidTimerID && !blink_timer_failed) {
+            Log(kWarn, "terminal %lu: no timer left for cursor blink\n",
+                task_id);
+        }
+        blink_timer_failed = blink_timer == kInvalidTimerID;
     };
 
     add_blink_timer(timer_manager->CurrentTick());
@@ -797,27 +926,25 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
     bool window_is_active = false;
 
     while (true) {
-        __asm__("cli");
-        auto msg = task.ReceiveMessage();
+        auto msg = task.WaitMessage();
         if (!msg) {
-            task.Sleep();
-            __asm__("sti");
             continue;
         }
-        __asm__("sti");
+
+        if (blink_timer_failed) {
+            add_blink_timer(timer_manager->CurrentTick());
+        }
 
         switch (msg->type) {
             case Message::kTimerTimeout: {
+                // アプリが残していったタイマで点滅用タイマを増やさない
+                if (msg->arg.timer.value != kBlinkTimerValue) {
+                    break;
+                }
+
                 add_blink_timer(msg->arg.timer.timeout);
                 if (show_window && window_is_active) {
-                    const auto area = terminal->BlinkCursor();
-                    Message msg =
-                        MakeLayerMessage(task_id, terminal->LayerID(),
-                                         LayerOperation::DrawArea, area);
-
-                    __asm__("cli");
-                    task_manager->SendMessage(1, msg);
-                    __asm__("sti");
+                    terminal->RequestDraw(terminal->BlinkCursor());
                 }
             } break;
             case Message::kKeyPush: {
@@ -826,15 +953,7 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
                         msg->arg.keyboard.modifier, msg->arg.keyboard.keycode,
                         msg->arg.keyboard.ascii);
 
-                    if (show_window) {
-                        Message msg =
-                            MakeLayerMessage(task_id, terminal->LayerID(),
-                                             LayerOperation::DrawArea, area);
-
-                        __asm__("cli");
-                        task_manager->SendMessage(1, msg);
-                        __asm__("sti");
-                    }
+                    terminal->RequestDraw(area);
                 }
             } break;
 
@@ -843,7 +962,7 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
                 break;
             case Message::KWindowClose:
                 CloseLayer(msg->arg.window_close.layer_id);
-                __asm__("cli");
+                timer_manager->CancelTimer(blink_timer, task_id);
                 task_manager->Finish(terminal->LastExitCode());
                 break;
 
@@ -858,18 +977,20 @@ TerminalFileDescriptor::TerminalFileDescriptor(Terminal& term) : term_{term} {}
 
 size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
     char* bufc = reinterpret_cast<char*>(buf);
+    // キー入力は端末のタスクに届くので，他のスレッドからは読めない
+    if (&task_manager->CurrentTask() != &term_.UnderlyingTask()) {
+        return 0;
+    }
 
+    // キー以外のメッセージは端末に戻ってから処理できるようにキューに残す
+    auto is_key = [](const Message& m) { return m.type == Message::kKeyPush; };
     while (true) {
-        __asm__("cli");
-        auto msg = term_.UnderlyingTask().ReceiveMessage();
+        auto msg = term_.UnderlyingTask().WaitMessage(is_key);
         if (!msg) {
-            term_.UnderlyingTask().Sleep();
-            continue;
+            return 0;
         }
 
-        __asm__("sti");
-
-        if (msg->type != Message::kKeyPush || !msg->arg.keyboard.press) {
+        if (!msg->arg.keyboard.press) {
             continue;
         }
 
@@ -887,85 +1008,46 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
 
         bufc[0] = msg->arg.keyboard.ascii;
         term_.Print(bufc, 1);
-        term_.Redraw();
         return 1;
     }
 };
 
 size_t TerminalFileDescriptor::Write(const void* buf, size_t len) {
-    term_.Print(reinterpret_cast<const char*>(buf), len);
-    term_.Redraw();
-    return len;
-}
-
-size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
-    return 0;
-}
-
-PipeDescriptor::PipeDescriptor(Task& task) : task_{task} {}
-
-size_t PipeDescriptor::Read(void* buf, size_t len) {
-    if (len_ > 0) {
-        const size_t copy_bytes = std::min(len_, len);
-        memcpy(buf, data_, copy_bytes);
-        len_ -= copy_bytes;
-        memmove(data_, &data_[copy_bytes], len_);
-        return copy_bytes;
-    }
-
-    if (closed_) {
-        return 0;
-    }
-
-    while (true) {
-        __asm__("cli");
-        auto msg = task_.ReceiveMessage();
-        if (!msg) {
-            task_.Sleep();
-            continue;
-        }
-        __asm__("sti");
-
-        if (msg->type != Message::kPipe) {
-            continue;
-        }
-
-        if (msg->arg.pipe.len == 0) {
-            closed_ = true;
-            return 0;
+    auto bufc = reinterpret_cast<const char*>(buf);
+    size_t begin = 0;
+
+    // 前回途切れた文字を，今回の先頭のバイトで完成させてから表示する
+    if (u8_tail_len_ > 0) {
+        const size_t need = CountUTF8Size(u8_tail_[0]) - u8_tail_len_;
+        begin = std::min(need, len);
+        memcpy(&u8_tail_[u8_tail_len_], bufc, begin);
+        u8_tail_len_ += begin;
+        if (begin < need) {
+            return len;
         }
 
-        const size_t copy_bytes = std::min<size_t>(msg->arg.pipe.len, len);
-        memcpy(buf, msg->arg.pipe.data, copy_bytes);
-        len_ = msg->arg.pipe.len - copy_bytes;
-        memcpy(data_, &msg->arg.pipe.data[copy_bytes], len_);
-        return copy_bytes;
+        term_.Print(u8_tail_, u8_tail_len_);
+        u8_tail_len_ = 0;
     }
-}
-
-size_t PipeDescriptor::Write(const void* buf, size_t len) {
-    auto bufc = reinterpret_cast<const char*>(buf);
-    Message msg{Message::kPipe};
-    size_t sent_bytes = 0;
-
-    while (sent_bytes < len) {
-        msg.arg.pipe.len =
-            std::min(len - sent_bytes, sizeof(msg.arg.pipe.data));
-        memcpy(msg.arg.pipe.data, &bufc[sent_bytes], msg.arg.pipe.len);
-        sent_bytes += msg.arg.pipe.len;
 
-        __asm__("cli");
-        task_.SendMessage(msg);
-        __asm__("sti");
+    // 末尾で途切れている文字は次の書き込みまで持ち越す
+    size_t end = len;
+    for (size_t back = 1; back <= 3 && back <= len - begin; ++back) {
+        const uint8_t c = bufc[len - back];
+        if ((c & 0xc0) != 0x80) {
+            if (CountUTF8Size(c) > back) {
+                end = len - back;
+            }
+            break;
+        }
     }
 
+    term_.Print(&bufc[begin], end - begin);
+    memcpy(u8_tail_, &bufc[end], len - end);
+    u8_tail_len_ = len - end;
     return len;
 }
 
-void PipeDescriptor::FinishWrite() {
-    Message msg{Message::kPipe};
-    msg.arg.pipe.len = 0;
-    __asm__("cli");
-    task_.SendMessage(msg);
-    __asm__("sti");
+size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
+    return 0;
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "file.hpp"
 #include "layer.hpp"
 #include "paging.hpp"
+#include "pipe.hpp"
 #include "task.hpp"
 #include "window.hpp"
 
@@ -42,6 +43,8 @@ class Terminal {
     Task& UnderlyingTask() const { return task_; }
     int LastExitCode() const { return last_exit_code_; }
     void Redraw();
+    // ウィンドウのareaを画面へ写させる
+    void RequestDraw(const Rectangle<int>& area);
 
    private:
     std::shared_ptr<ToplevelWindow> window_;
@@ -56,6 +59,10 @@ class Terminal {
     int linebuf_index_{0};
     std::array<char, kLineMax> linebuf_{};
     void Scroll1();
+    // これまでにスクロールした行数
+    int scrolled_rows_{0};
+    // scrolled_beforeだけスクロールしていたときのrow行目から，カーソルの行までの範囲
+    Rectangle<int> RowsSince(int row, int scrolled_before) const;
 
     void ExecuteLine();
     WithError<int> ExecuteFile(fat::DirectoryEntry& file_entry, char* command,
@@ -83,21 +90,7 @@ class TerminalFileDescriptor : public FileDescriptor {
 
    private:
     Terminal& term_;
+    // 前回の書き込みの末尾で途切れたUTF-8の文字
+    char u8_tail_[4];
+    size_t u8_tail_len_{0};
 };
-
-class PipeDescriptor : public FileDescriptor {
-   public:
-    explicit PipeDescriptor(Task& task);
-    size_t Read(void* buf, size_t len) override;
-    size_t Write(const void* buf, size_t len) override;
-    size_t Size() const override { return 0; }
-    size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
-
-    void FinishWrite();
-
-   private:
-    Task& task_;
-    char data_[16];
-    size_t len_{0};
-    bool closed_{false};
-};
\ No newline at end of file
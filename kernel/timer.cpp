@@ -42,51 +42,182 @@ uint32_t LAPICTimerElapsed() { return kCountMax - current_count; }
 
 void StopLAPICTimer() { initial_count = 0; }
 
+unsigned long LAPICTimerCount() {
+    static unsigned long last_count = 0;
+    InterruptGuard guard;
+    // 周期モードのカウンタは割り込みごとに初期値へ戻るので，ティック数で補う
+    // 割り込みの処理前に読むと戻って見えるため，前回の値を下回らないようにする
+    const unsigned long period = lapic_timer_freq / kTimerFreq;
+    const unsigned long count =
+        timer_manager->CurrentTick() * period + (period - current_count);
+    if (count > last_count) {
+        last_count = count;
+    }
+    return last_count;
+}
+
 Timer::Timer(unsigned long timeout, int value, uint64_t task_id)
     : timeout_{timeout}, value_{value}, task_id_{task_id} {}
 
 TimerManager::TimerManager() {
-    timers_.push(Timer{std::numeric_limits<unsigned long>::max(), -1, 1});
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        nodes_[i].next = free_nodes_;
+        free_nodes_ = &nodes_[i];
+    }
 }
 
-void TimerManager::AddTimer(const Timer& timer) { timers_.push(timer); }
+TimerID TimerManager::AddTimer(const Timer& timer) {
+    ScopedIRQLock lock{lock_};
+    TimerNode* node = free_nodes_;
+    if (node == nullptr) {
+        return kInvalidTimerID;
+    }
+    free_nodes_ = node->next;
+
+    node->timer = timer;
+    // 既に期限を過ぎているタイマは次のティックで満了させる
+    Enqueue(node, std::max(timer.Timeout(), tick_ + 1));
+
+    const uint64_t index = node - &nodes_[0];
+    return static_cast<uint64_t>(node->generation) << 32 | (index + 1);
+}
+
+Error TimerManager::CancelTimer(TimerID id, uint64_t task_id) {
+    const uint64_t index = (id & 0xffffffffu) - 1;
+    if (id == kInvalidTimerID || index >= nodes_.size()) {
+        return MAKE_ERROR(Error::kNoSuchEntry);
+    }
+
+    ScopedIRQLock lock{lock_};
+    TimerNode* node = &nodes_[index];
+    if (node->slot == nullptr || node->generation != (id >> 32) ||
+        node->timer.TaskID() != task_id) {
+        return MAKE_ERROR(Error::kNoSuchEntry);
+    }
+
+    Unlink(node);
+    FreeNode(node);
+    return MAKE_ERROR(Error::kSuccess);
+}
 
 TimerManager* timer_manager;
 unsigned long lapic_timer_freq;
 
+// タイマ割り込みから呼ばれるので，割り込みは既に禁止されている
 bool TimerManager::Tick() {
+    ScopedLock lock{lock_};
     ++tick_;
 
-    bool task_timer_timeout = false;
-    while (true) {
-        const auto& timer = timers_.top();
-        if (timer.Timeout() > tick_) {
+    // 下位のホイールが一周したら上位のホイールのスロットを下位へ振り分ける
+    for (int level = 1; level < kWheelLevels; ++level) {
+        if ((tick_ & ((1ul << (kWheelBits * level)) - 1)) != 0) {
             break;
         }
+        Cascade(level);
+    }
 
-        if (timer.Value() == kTaskTimerValue) {
+    bool task_timer_timeout = false;
+    TimerNode* node = DetachSlot(0, tick_ & (kWheelSize - 1));
+    while (node) {
+        TimerNode* next = node->next;
+        const auto& timer = node->timer;
+
+        if (timer.Timeout() > tick_) {
+            Enqueue(node, timer.Timeout());
+        } else if (timer.Value() == kTaskTimerValue) {
             task_timer_timeout = true;
-            timers_.pop();
-            timers_.push(Timer{tick_ + kTaskTimerPeriod, kTaskTimerValue, 1});
-            continue;
+            node->timer = Timer{tick_ + kTaskTimerPeriod, kTaskTimerValue, 1};
+            Enqueue(node, node->timer.Timeout());
+        } else {
+            Message message{Message::kTimerTimeout};
+            message.arg.timer.timeout = timer.Timeout();
+            message.arg.timer.value = timer.Value();
+            task_manager->SendMessage(timer.TaskID(), message);
+            FreeNode(node);
         }
 
-        Message message{Message::kTimerTimeout};
-        message.arg.timer.timeout = timer.Timeout();
-        message.arg.timer.value = timer.Value();
-        task_manager->SendMessage(timer.TaskID(), message);
-
-        timers_.pop();
+        node = next;
     }
 
     return task_timer_timeout;
 }
 
+void TimerManager::Enqueue(TimerNode* node, unsigned long expires) {
+    const unsigned long kMaxDelta = (1ul << (kWheelBits * kWheelLevels)) - 1;
+    if (expires - tick_ > kMaxDelta) {
+        // 最上位のホイールにも収まらないタイマは、届く範囲の最後に置いて再配置を待つ
+        expires = tick_ + kMaxDelta;
+    }
+
+    const unsigned long delta = expires - tick_;
+    int level = 0;
+    while (level < kWheelLevels - 1 &&
+           delta >= (1ul << (kWheelBits * (level + 1)))) {
+        ++level;
+    }
+
+    const int index = (expires >> (kWheelBits * level)) & (kWheelSize - 1);
+    TimerNode** slot = &wheels_[level][index];
+
+    node->slot = slot;
+    node->prev = nullptr;
+    node->next = *slot;
+    if (*slot) {
+        (*slot)->prev = node;
+    }
+    *slot = node;
+}
+
+void TimerManager::Unlink(TimerNode* node) {
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        *node->slot = node->next;
+    }
+
+    if (node->next) {
+        node->next->prev = node->prev;
+    }
+
+    node->slot = nullptr;
+}
+
+void TimerManager::FreeNode(TimerNode* node) {
+    node->slot = nullptr;
+    // 取り消し済みのTimerIDで別のタイマを消さないよう世代を進める
+    ++node->generation;
+    node->next = free_nodes_;
+    free_nodes_ = node;
+}
+
+TimerManager::TimerNode* TimerManager::DetachSlot(int level, int index) {
+    TimerNode* head = wheels_[level][index];
+    wheels_[level][index] = nullptr;
+    for (TimerNode* node = head; node; node = node->next) {
+        node->slot = nullptr;
+    }
+    return head;
+}
+
+void TimerManager::Cascade(int level) {
+    const unsigned long now = tick_;
+    const int index = (now >> (kWheelBits * level)) & (kWheelSize - 1);
+    TimerNode* node = DetachSlot(level, index);
+    while (node) {
+        TimerNode* next = node->next;
+        Enqueue(node, std::max(node->timer.Timeout(), now));
+        node = next;
+    }
+}
+
 extern "C" void LAPICTimerOnInterrupt(const TaskContext& ctx_stack) {
     const bool task_timer_timeout = timer_manager->Tick();
     NotifyEndOfInterrupt();
 
     if (task_timer_timeout) {
         task_manager->SwitchTask(ctx_stack);
+    } else if (task_manager->ReschedulePending()) {
+        // タイマの満了で高いレベルのタスクが起きた
+        task_manager->SwitchTask(ctx_stack, false);
     }
 }
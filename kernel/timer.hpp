@@ -1,43 +1,76 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <queue>
-#include <vector>
+#include <limits>
 
+#include "error.hpp"
+#include "lock.hpp"
 #include "message.hpp"
 
 void InitializeLAPICTimer();
 void StartLAPICTimer();
 uint32_t LAPICTimerElapsed();
 void StopLAPICTimer();
+// 起動からの経過時間をLAPICタイマのカウント単位で返す．単調増加する
+unsigned long LAPICTimerCount();
+
+// AddTimerが返すタイマの識別子 0は無効なタイマを表す
+using TimerID = uint64_t;
+const TimerID kInvalidTimerID = 0;
 
 class Timer {
    public:
+    Timer() = default;
     Timer(unsigned long timeout, int value, uint64_t task_id);
     unsigned long Timeout() const { return timeout_; }
     int Value() const { return value_; }
     uint64_t TaskID() const { return task_id_; }
 
    private:
-    unsigned long timeout_;
-    int value_;
-    uint64_t task_id_;
+    unsigned long timeout_{0};
+    int value_{0};
+    uint64_t task_id_{0};
 };
 
-inline bool operator<(const Timer& lhs, const Timer& rhs) {
-    return lhs.Timeout() > rhs.Timeout();
-}
-
+// 階層タイミングホイール
+// 登録・取り消し・満了の処理はタイマの数によらず定数時間で終わる
 class TimerManager {
    public:
+    static const int kWheelBits = 6;
+    static const int kWheelSize = 1 << kWheelBits;
+    static const int kWheelLevels = 4;
+    static const size_t kMaxTimers = 1024;
+
     TimerManager();
-    void AddTimer(const Timer& timer);
+    TimerID AddTimer(const Timer& timer);
+    Error CancelTimer(TimerID id, uint64_t task_id);
     bool Tick();
     unsigned long CurrentTick() const { return tick_; }
 
    private:
+    struct TimerNode {
+        Timer timer;
+        TimerNode* prev;
+        TimerNode* next;
+        // 所属しているスロット 未使用のノードではnullptr
+        TimerNode** slot;
+        uint32_t generation;
+    };
+
+    // ホイールはタイマ割り込みからも操作される
+    SpinLock lock_;
     volatile unsigned long tick_{0};
-    std::priority_queue<Timer> timers_{};
+    // タイマ用のノードはあらかじめ確保しておき、割り込み中にメモリを確保しない
+    std::array<TimerNode, kMaxTimers> nodes_{};
+    TimerNode* free_nodes_{nullptr};
+    std::array<std::array<TimerNode*, kWheelSize>, kWheelLevels> wheels_{};
+
+    void Enqueue(TimerNode* node, unsigned long expires);
+    void Unlink(TimerNode* node);
+    void FreeNode(TimerNode* node);
+    TimerNode* DetachSlot(int level, int index);
+    void Cascade(int level);
 };
 
 extern TimerManager* timer_manager;
@@ -34,42 +34,51 @@ void DrawTextbox(ScreenDrawer& drawer, Vector2D<int> pos, Vector2D<int> size,
 
 Window::Window(int width, int height, PixelFormat shadow_format)
     : width_{width}, height_{height} {
-    data_.resize(height);
-    for (int y = 0; y < height; ++y) {
-        data_[y].resize(width);
-    }
-
     FrameBufferConfig config{};
     config.frame_buffer = nullptr;
     config.horizontal_resolution = width;
     config.vertical_resolution = height;
     config.pixel_format = shadow_format;
 
-    if (auto err = shadow_buffer_.Initialize(config)) {
-        Log(kError, "failed to initialize shadow buffer: %s at %s:%d\n",
+    if (auto err = buffer_.Initialize(config)) {
+        Log(kError, "failed to initialize window buffer: %s at %s:%d\n",
             err.Name(), err.File(), err.Line());
     }
 }
 
 void Window::DrawTo(FrameBuffer& dst, Vector2D<int> position,
                     const Rectangle<int>& area) {
+    Rectangle<int> window_area{position, Size()};
+    Rectangle<int> intersection = area & window_area;
+    const Rectangle<int> src_area{intersection.pos - position,
+                                  intersection.size};
+
     if (!transparent_color_) {
-        Rectangle<int> window_area{position, Size()};
-        Rectangle<int> intersection = area & window_area;
-        dst.Copy(intersection.pos, shadow_buffer_,
-                 {intersection.pos - position, intersection.size});
+        dst.Copy(intersection.pos, buffer_, src_area);
         return;
     }
 
-    const auto tc = transparent_color_.value();
-    auto& drawer = dst.Drawer();
-
-    for (int y = 0; y < std::min(Height(), drawer.Height() - position.y); ++y) {
-        for (int x = std::max(0, 0 - position.x);
-             x < std::min(Width(), drawer.Width() - position.x); ++x) {
-            const auto c = At(Vector2D<int>{x, y});
-            if (c != tc) {
-                drawer.Draw(position + Vector2D<int>{x, y}, c);
+    // 書き換えが続いている間は透明色との比較で写し，落ち着いたら範囲を作る
+    if (!OpaqueSpansValid() && modified_) {
+        modified_ = false;
+        dst.CopyTransparent(intersection.pos, buffer_, src_area,
+                            transparent_color_.value());
+        return;
+    }
+    if (!OpaqueSpansValid()) {
+        BuildOpaqueSpans();
+    }
+
+    const int x_end = src_area.pos.x + src_area.size.x;
+    for (int y = src_area.pos.y; y < src_area.pos.y + src_area.size.y; ++y) {
+        for (size_t i = opaque_row_begin_[y]; i < opaque_row_begin_[y + 1];
+             ++i) {
+            const auto& span = opaque_spans_[i];
+            const int x0 = std::max(span.x, src_area.pos.x);
+            const int x1 = std::min(span.x + span.len, x_end);
+            if (x0 < x1) {
+                dst.Copy(position + Vector2D<int>{x0, y}, buffer_,
+                         {{x0, y}, {x1 - x0, 1}});
             }
         }
     }
@@ -77,17 +86,46 @@ void Window::DrawTo(FrameBuffer& dst, Vector2D<int> position,
 
 void Window::SetTransparentColor(std::optional<PixelColor> c) {
     transparent_color_ = c;
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+void Window::BuildOpaqueSpans() {
+    // 読み始める前の世代を記録する．作っている途中で書き換えられると
+    // 世代が進むので，次のDrawToで作り直される
+    const uint64_t generation = generation_.load(std::memory_order_acquire);
+
+    const auto tc = transparent_color_.value();
+    opaque_spans_.clear();
+    opaque_row_begin_.resize(height_ + 1);
+
+    for (int y = 0; y < height_; ++y) {
+        opaque_row_begin_[y] = opaque_spans_.size();
+        int x = 0;
+        while (x < width_) {
+            while (x < width_ && At({x, y}) == tc) {
+                ++x;
+            }
+            const int begin = x;
+            while (x < width_ && At({x, y}) != tc) {
+                ++x;
+            }
+            if (begin < x) {
+                opaque_spans_.push_back({begin, x - begin});
+            }
+        }
+    }
+    opaque_row_begin_[height_] = opaque_spans_.size();
+    opaque_spans_generation_ = generation;
 }
 
 Window::WindowDrawer* Window::Drawer() { return &drawer_; }
 
 void Window::Draw(Vector2D<int> pos, PixelColor c) {
-    data_[pos.y][pos.x] = c;
-    shadow_buffer_.Drawer().Draw(pos, c);
+    Modify([&](auto& d) { d.Draw(pos, c); });
 }
 
-const PixelColor& Window::At(Vector2D<int> pos) const {
-    return data_[pos.y][pos.x];
+PixelColor Window::At(Vector2D<int> pos) const {
+    return buffer_.Drawer().At(pos);
 }
 
 int Window::Width() const { return width_; }
@@ -97,7 +135,7 @@ int Window::Height() const { return height_; }
 Vector2D<int> Window::Size() const { return {width_, height_}; }
 
 void Window::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
-    shadow_buffer_.Move(dst_pos, src);
+    Modify([&](auto&) { buffer_.Move(dst_pos, src); });
 }
 
 WindowRegion Window::GetWindowRegion(Vector2D<int> pos) {
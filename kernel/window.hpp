@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <optional>
 #include <string>
 #include <vector>
@@ -26,6 +27,26 @@ class Window {
         virtual int Width() const override { return window_.Width(); }
         virtual int Height() const override { return window_.Height(); }
 
+        // まとめて描く操作はウィンドウのバッファへそのまま渡す
+        virtual void FillSpan(Vector2D<int> pos, int len,
+                              const PixelColor& c) override {
+            window_.Modify([&](auto& d) { d.FillSpan(pos, len, c); });
+        }
+        virtual void FillRect(Vector2D<int> pos, Vector2D<int> size,
+                              const PixelColor& c) override {
+            window_.Modify([&](auto& d) { d.FillRect(pos, size, c); });
+        }
+        virtual void BlitRow(Vector2D<int> pos, const PixelColor* colors,
+                             int len) override {
+            window_.Modify([&](auto& d) { d.BlitRow(pos, colors, len); });
+        }
+        virtual void BlitMask(Vector2D<int> pos, const uint8_t* mask, int pitch,
+                              Vector2D<int> size,
+                              const PixelColor& c) override {
+            window_.Modify(
+                [&](auto& d) { d.BlitMask(pos, mask, pitch, size, c); });
+        }
+
        private:
         Window& window_;
     };
@@ -38,9 +59,11 @@ class Window {
     void DrawTo(FrameBuffer& dst, Vector2D<int> position,
                 const Rectangle<int>& area);
     void SetTransparentColor(std::optional<PixelColor> c);
+    // 透明色がなければ，下にあるレイヤを完全に隠す
+    bool IsOpaque() const { return !transparent_color_; }
     WindowDrawer* Drawer();
 
-    const PixelColor& At(Vector2D<int> pos) const;
+    PixelColor At(Vector2D<int> pos) const;
 
     void Draw(Vector2D<int> pos, PixelColor c);
 
@@ -57,11 +80,39 @@ class Window {
 
    private:
     int width_, height_;
-    std::vector<std::vector<PixelColor>> data_{};
     WindowDrawer drawer_{*this};
     std::optional<PixelColor> transparent_color_{std::nullopt};
 
-    FrameBuffer shadow_buffer_{};
+    // 画面と同じ形式で画素を保持する．描画も読み出しもここだけを使う
+    FrameBuffer buffer_{};
+
+    // 透明色でない画素が横に並ぶ範囲．y行目の範囲は
+    // opaque_spans_[opaque_row_begin_[y]]からopaque_spans_[opaque_row_begin_[y + 1]]の手前まで
+    struct OpaqueSpan {
+        int x, len;
+    };
+    std::vector<OpaqueSpan> opaque_spans_{};
+    std::vector<size_t> opaque_row_begin_{};
+    // 画素や透明色を変えるたびに増える．範囲はopaque_spans_generation_の時点のもの
+    // アプリはlayer_mutexを持たずに描くので，合成と並行して増えることがある
+    std::atomic<uint64_t> generation_{1};
+    uint64_t opaque_spans_generation_{0};
+    // 前回のDrawToから画素が書き換えられたらtrue
+    bool modified_{true};
+
+    // 画素を書き換えるときはここを通す
+    // 書き換えた後で世代を進めるので，途中で作られた範囲が有効なまま残ることはない
+    template <class Func>
+    void Modify(Func f) {
+        f(buffer_.Drawer());
+        modified_ = true;
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    bool OpaqueSpansValid() const {
+        return opaque_spans_generation_ ==
+               generation_.load(std::memory_order_acquire);
+    }
+    void BuildOpaqueSpans();
 };
 
 class ToplevelWindow : public Window {
@@ -86,6 +137,25 @@ class ToplevelWindow : public Window {
             return window_.Height() - kTopLeftMargin.y - kBottomRightMargin.y;
         }
 
+        virtual void FillSpan(Vector2D<int> pos, int len,
+                              const PixelColor& c) override {
+            window_.Drawer()->FillSpan(pos + kTopLeftMargin, len, c);
+        }
+        virtual void FillRect(Vector2D<int> pos, Vector2D<int> size,
+                              const PixelColor& c) override {
+            window_.Drawer()->FillRect(pos + kTopLeftMargin, size, c);
+        }
+        virtual void BlitRow(Vector2D<int> pos, const PixelColor* colors,
+                             int len) override {
+            window_.Drawer()->BlitRow(pos + kTopLeftMargin, colors, len);
+        }
+        virtual void BlitMask(Vector2D<int> pos, const uint8_t* mask, int pitch,
+                              Vector2D<int> size,
+                              const PixelColor& c) override {
+            window_.Drawer()->BlitMask(pos + kTopLeftMargin, mask, pitch, size,
+                                       c);
+        }
+
        private:
         ToplevelWindow& window_;
     };